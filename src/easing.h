@@ -1,6 +1,8 @@
 #ifndef EASING_H
 #define EASING_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -58,6 +60,39 @@ float easeInBack(float x);
 float easeOutBack(float x);
 float easeInOutBack(float x);
 
+typedef float (*EasingFunction)(float x);
+
+// Batch Easing
+// Evaluates easing over count values of xs into out (out may alias xs)
+void easeBatch(EasingFunction f, const float* xs, float* out, size_t count);
+
+// Batch Polynomial Easing (power 1..5 matches Linear, Quad, Cubic, Quart, Quint)
+// Integer powers only, values below 1 are treated as 1
+// Uses AVX when compiled with -mavx, SSE otherwise on x86, scalar fallback elsewhere
+void easeInPowBatch(int power, const float* xs, float* out, size_t count);
+void easeOutPowBatch(int power, const float* xs, float* out, size_t count);
+void easeInOutPowBatch(int power, const float* xs, float* out, size_t count);
+// Largest difference of the In, Out and InOut batches from the scalar functions for power 1..5
+float easePowBatchMaxError(int power, int probes);
+
+// Lookup Table Easing
+// Samples f at resolution + 1 evenly spaced points in [0, 1] and interpolates linearly.
+// Error bound: |f(x) - sample(x)| <= h^2 / 8 * max|f''|, where h = 1 / resolution,
+// for curves with continuous second derivative (Quad..Quint, Sine, Circ away from the ends, Back, Expo).
+// Bounce has derivative jumps, so its error is only O(h); Elastic has large |f''| (~4000 for In/Out),
+// so it needs resolution >= 1024 for errors below 1e-3. easingTableMaxError() measures the real value.
+typedef struct {
+    EasingFunction function;
+    int resolution;
+    float* samples;
+} EasingTable;
+
+EasingTable easingTableCreate(EasingFunction f, int resolution);
+void easingTableFree(EasingTable* table);
+float easingTableSample(const EasingTable* table, float x);
+void easingTableSampleBatch(const EasingTable* table, const float* xs, float* out, size_t count);
+float easingTableMaxError(const EasingTable* table, int probes);
+
 #ifdef __cplusplus
 }
 #endif
@@ -68,6 +103,7 @@ float easeInOutBack(float x);
 #ifdef EASING_IMPLEMENTATION
 
 #include <math.h>
+#include <stdlib.h>
 
 // Linear Easing
 float easeLinear(float x) {
@@ -239,4 +275,210 @@ float easeInOutBack(float x) {
                    : (powf(2 * x - 2, 2) * ((c2 + 1) * (x * 2 - 2) + c2) + 2) / 2;
 }
 
+// Batch Easing
+void easeBatch(EasingFunction f, const float* xs, float* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) out[i] = f(xs[i]);
+}
+
+static inline float easingPowi(float x, int power) {
+    float r = 1;
+    for (int i = 0; i < power; ++i) r *= x;
+    return r;
+}
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+static inline __m256 easingPowi8(__m256 x, int power) {
+    __m256 r = x;
+    for (int i = 1; i < power; ++i) r = _mm256_mul_ps(r, x);
+    return r;
+}
+
+#elif defined(__SSE__)
+
+#include <xmmintrin.h>
+
+#define EASING_SSE
+
+static inline __m128 easingPowi4(__m128 x, int power) {
+    __m128 r = x;
+    for (int i = 1; i < power; ++i) r = _mm_mul_ps(r, x);
+    return r;
+}
+
+#endif
+
+void easeInPowBatch(int power, const float* xs, float* out, size_t count) {
+    if (power < 1) power = 1;
+    size_t i = 0;
+#if defined(__AVX__)
+    const size_t end = count & ~(size_t) 7;
+    for (; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        _mm256_storeu_ps(out + i, easingPowi8(x, power));
+    }
+#elif defined(EASING_SSE)
+    const size_t end = count & ~(size_t) 3;
+    for (; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        _mm_storeu_ps(out + i, easingPowi4(x, power));
+    }
+#endif
+    for (; i < count; ++i) out[i] = easingPowi(xs[i], power);
+}
+
+void easeOutPowBatch(int power, const float* xs, float* out, size_t count) {
+    if (power < 1) power = 1;
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const size_t end = count & ~(size_t) 7;
+    for (; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        _mm256_storeu_ps(out + i, _mm256_sub_ps(one, easingPowi8(_mm256_sub_ps(one, x), power)));
+    }
+#elif defined(EASING_SSE)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const size_t end = count & ~(size_t) 3;
+    for (; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        _mm_storeu_ps(out + i, _mm_sub_ps(one, easingPowi4(_mm_sub_ps(one, x), power)));
+    }
+#endif
+    for (; i < count; ++i) out[i] = 1 - easingPowi(1 - xs[i], power);
+}
+
+void easeInOutPowBatch(int power, const float* xs, float* out, size_t count) {
+    // x < 0.5 ? 2^(p-1) * x^p : 1 - (2 - 2x)^p / 2
+    if (power < 1) power = 1;
+    const float inScale = powf(2, power - 1);
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 scale = _mm256_set1_ps(inScale);
+    const size_t end = count & ~(size_t) 7;
+    for (; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        __m256 in = _mm256_mul_ps(scale, easingPowi8(x, power));
+        __m256 o = _mm256_sub_ps(one, _mm256_mul_ps(half, easingPowi8(_mm256_sub_ps(two, _mm256_mul_ps(two, x)), power)));
+        __m256 mask = _mm256_cmp_ps(x, half, _CMP_LT_OQ);
+        _mm256_storeu_ps(out + i, _mm256_blendv_ps(o, in, mask));
+    }
+#elif defined(EASING_SSE)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 scale = _mm_set1_ps(inScale);
+    const size_t end = count & ~(size_t) 3;
+    for (; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 in = _mm_mul_ps(scale, easingPowi4(x, power));
+        __m128 o = _mm_sub_ps(one, _mm_mul_ps(half, easingPowi4(_mm_sub_ps(two, _mm_mul_ps(two, x)), power)));
+        __m128 mask = _mm_cmplt_ps(x, half);
+        _mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(mask, in), _mm_andnot_ps(mask, o)));
+    }
+#endif
+    for (; i < count; ++i) {
+        float x = xs[i];
+        out[i] = x < 0.5f ? inScale * easingPowi(x, power) : 1 - easingPowi(2 - 2 * x, power) / 2;
+    }
+}
+
+float easePowBatchMaxError(int power, int probes) {
+    static const EasingFunction in[] = {easeLinear, easeInQuad, easeInCubic, easeInQuart, easeInQuint};
+    static const EasingFunction out[] = {easeLinear, easeOutQuad, easeOutCubic, easeOutQuart, easeOutQuint};
+    static const EasingFunction inOut[] = {easeLinear, easeInOutQuad, easeInOutCubic, easeInOutQuart, easeInOutQuint};
+    if (power < 1 || power > 5 || probes < 1) return 0;
+
+    float maxError = 0;
+    float xs[64], ys[3][64];
+    for (int start = 0; start <= probes; start += 64) {
+        int count = probes + 1 - start < 64 ? probes + 1 - start : 64;
+        for (int i = 0; i < count; ++i) xs[i] = (float) (start + i) / probes;
+
+        easeInPowBatch(power, xs, ys[0], count);
+        easeOutPowBatch(power, xs, ys[1], count);
+        easeInOutPowBatch(power, xs, ys[2], count);
+
+        for (int i = 0; i < count; ++i) {
+            float errors[3] = {fabsf(in[power - 1](xs[i]) - ys[0][i]), fabsf(out[power - 1](xs[i]) - ys[1][i]),
+                               fabsf(inOut[power - 1](xs[i]) - ys[2][i])};
+            for (int e = 0; e < 3; ++e)
+                if (errors[e] > maxError) maxError = errors[e];
+        }
+    }
+    return maxError;
+}
+
+// Lookup Table Easing
+EasingTable easingTableCreate(EasingFunction f, int resolution) {
+    EasingTable table = {0};
+    if (resolution < 1) resolution = 1;
+
+    table.function = f;
+    table.resolution = resolution;
+    // one extra sample past the end so x == 1 can interpolate without a branch
+    table.samples = malloc((resolution + 2) * sizeof(float));
+
+    for (int i = 0; i <= resolution; ++i) table.samples[i] = f((float) i / resolution);
+    table.samples[resolution + 1] = table.samples[resolution];
+
+    return table;
+}
+
+void easingTableFree(EasingTable* table) {
+    free(table->samples);
+    table->samples = NULL;
+    table->resolution = 0;
+}
+
+float easingTableSample(const EasingTable* table, float x) {
+    if (x <= 0) return table->samples[0];
+    if (x >= 1) return table->samples[table->resolution];
+
+    float position = x * table->resolution;
+    int index = (int) position;
+    float t = position - index;
+
+    return table->samples[index] + (table->samples[index + 1] - table->samples[index]) * t;
+}
+
+void easingTableSampleBatch(const EasingTable* table, const float* xs, float* out, size_t count) {
+    const float* samples = table->samples;
+    const float resolution = (float) table->resolution;
+    size_t i = 0;
+#if defined(EASING_SSE) || defined(__AVX__)
+    // index math is vectorized, the two sample loads per lane stay scalar (no gather before AVX2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 res = _mm_set1_ps(resolution);
+    float positions[4];
+    const size_t end = count & ~(size_t) 3;
+    for (; i < end; i += 4) {
+        __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(xs + i), zero), one);
+        _mm_storeu_ps(positions, _mm_mul_ps(x, res));
+        for (int lane = 0; lane < 4; ++lane) {
+            int index = (int) positions[lane];
+            float t = positions[lane] - index;
+            out[i + lane] = samples[index] + (samples[index + 1] - samples[index]) * t;
+        }
+    }
+#endif
+    for (; i < count; ++i) out[i] = easingTableSample(table, xs[i]);
+}
+
+float easingTableMaxError(const EasingTable* table, int probes) {
+    float maxError = 0;
+    for (int i = 0; i <= probes; ++i) {
+        float x = (float) i / probes;
+        float error = fabsf(table->function(x) - easingTableSample(table, x));
+        if (error > maxError) maxError = error;
+    }
+    return maxError;
+}
+
 #endif // EASING_IMPLEMENTATION
@@ -7,8 +7,23 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <termios.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#endif
 
 #include <raylib.h>
 #include <raymath.h>
@@ -26,7 +41,7 @@
 #define MAP_WIDTH 128
 #define MAP_HEIGHT 128
 #define MAP_GENERATOR_BORDERS_PADDING 3
-#define MAP_GENERATOR_ITERATIONS_COUNT MAP_WIDTH * MAP_HEIGHT * 0.5
+#define MAP_GENERATOR_STEPS_PERCENT 50 // worm walk steps per 100 map tiles
 #define MAP_GENERATOR_STEP_DIRECTION_CHANGE_CHANCE 3
 #define MAP_GENERATOR_STEP_ROOM_CHANCE 5
 #define MAP_GENERATOR_STEP_ROOM_COOLDOWN 25
@@ -34,7 +49,60 @@
 #define ROOM_MAX_WIDTH 10
 #define ROOM_MIN_HEIGHT 3
 #define ROOM_MAX_HEIGHT 10
-#define MAX_ROOMS_COUNT(mapWidth, mapHeight) (int) floor(((double)(mapWidth*mapHeight)) / ((double)(ROOM_MIN_WIDTH*ROOM_MIN_HEIGHT)))
+#define BSP_MIN_LEAF_SIZE 10
+#define BSP_ROOM_PADDING 1
+#define CAVE_INITIAL_WALL_CHANCE 45
+#define CAVE_ITERATIONS_COUNT 5
+#define MAX_ROOMS_COUNT(mapWidth, mapHeight, params) (int) floor(((double)(mapWidth*mapHeight)) / ((double)((params)->roomMinWidth*(params)->roomMinHeight)))
+#define MAP_GENERATION_BATCH_SEEDS_COUNT 1000
+#define MAP_GENERATION_BATCH_MAX_THREADS 256
+#define MAP_GENERATOR_WORM_ATTEMPTS_PER_STEP 16 // bounds worm walks that keep hitting the padding
+#define FOV_TABLES_MAX_COUNT 16
+#define AUTO_EXPLORE_STEPS_PER_COMMAND 16 // the rest of the leg continues with the next command
+
+#define VISITED_TILE_ALPHA 0.05f
+#define CAMERA_SNAP_DISTANCE 0.5f
+#define CAMERA_ZOOM_MIN 0.02f
+#define CAMERA_ZOOM_MAX 2.0f
+#define CAMERA_ZOOM_STEP 1.15f // per mouse wheel notch
+#define CAMERA_LOD_CELL_SIZE 8.0f // on screen, below this tiles are drawn as colored blocks
+
+#define TERMINAL_STATUS_LINES 1
+
+#define INPUT_RECORDING_MAGIC 0x43524752 // "RGRC"
+#define INPUT_RECORDING_VERSION 3
+#define INPUT_RECORDING_CHECKPOINT 0xFF
+#define INPUT_RECORDING_CHECKPOINT_INTERVAL 64
+
+#define TILE_DEFS_PATH "assets/data/tiles.txt"
+#define TILE_TYPES_MAX_COUNT 256
+#define TILE_FLAG_BLOCKS_LOS 0x01
+#define TILE_FLAG_BLOCKS_MOVEMENT 0x02
+
+#define TILE_STATE_IN_LOS 0x01
+#define TILE_STATE_OVERRIDE 0x04 // has an entry in Map.overrides
+
+#define EXPLORED_CHUNK_SIZE 64 // tiles per side, so a chunk row is one bitplane word
+
+#define MAP_FILL_BLOCK_TILES 2048 // filled tile by tile, then copied over the rest of the map
+
+#define MAP_DIRTY_TILES_MAX_COUNT 65536 // past this the whole map is redrawn anyway
+#define MAP_TILE_OVERRIDES_MIN_CAPACITY 256
+
+#define LIGHT_CHUNK_SIZE 32 // light buffer is allocated in square chunks of tiles on first use
+#define LIGHT_AMBIENT 0.3f // brightness of tiles in LOS that no light reaches
+#define LIGHT_PLAYER_RADIUS 12
+#define LIGHT_TORCH_RADIUS 10
+
+#define MINIMAP_MAX_SIZE 256 // on screen, the texture itself is one pixel per tile
+#define MINIMAP_MARGIN 10
+#define MINIMAP_UPLOAD_ROWS 64 // texture rows uploaded per UpdateTextureRec call
+
+#define LEVEL_CACHE_MEMORY_BUDGET (256 * 1024)
+
+#define FONT_CODEPOINTS_COUNT (95 + 256)
+#define FONT_ATLAS_CACHE_MAGIC 0x41464752 // "RGFA"
+#define FONT_ATLAS_CACHE_VERSION 1
 
 const int WINDOW_WIDTH = 1280;
 const int WINDOW_HEIGHT = 720;
@@ -44,6 +112,66 @@ typedef struct {
     int y;
 } Coord;
 
+typedef struct {
+    uint64_t state;
+} Rng;
+
+// values are stored in input recordings, append new commands at the end
+typedef enum {
+    CommandNone = 0,
+    CommandMoveUp,
+    CommandMoveDown,
+    CommandMoveLeft,
+    CommandMoveRight,
+    CommandRunUp,
+    CommandRunDown,
+    CommandRunLeft,
+    CommandRunRight,
+    CommandAutoExplore,
+    CommandRegenerateMap,
+    CommandDescend,
+    CommandAscend,
+    CommandsCount,
+} Command;
+
+typedef struct {
+    FILE* file;
+    uint64_t seed;
+    size_t commandsCount;
+    bool checkpointPending; // came due while a level was generating
+} InputRecording;
+
+// inactive dungeon level, compressed in memory or spilled to disk
+typedef struct {
+    int depth;
+    uint64_t lastUsed;
+    uint8_t* data; // NULL while spilled to disk
+    size_t size;
+} CachedLevel;
+
+typedef struct {
+    CachedLevel* levels;
+    size_t levelsCount;
+    size_t levelsCapacity;
+    size_t memoryUsed;
+    size_t memoryBudget;
+    bool memoryBudgetSet;
+    uint64_t tick;
+} LevelCache;
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+    bool ok;
+} ByteReader;
+
 typedef struct {
     char ch;
     Color fgColor;
@@ -64,34 +192,187 @@ typedef enum {
     TileTypeEmpty = 0,
     TileTypeWall,
     TileTypeFloor,
+    TileTypeStairsDown,
+    TileTypeStairsUp,
+    TileTypesBuiltinCount,
 } TileType;
 
+// tile types past the built-in ones come only from the tile definitions file
 typedef struct {
-    TileType type;
-    Glyph glyph;
-    bool isInLOS;
-    bool isVisited;
+    char key[32];
+    char name[64];
+    char ch;
+    Color fgColor;
+    Color bgColor;
+    uint8_t flags;
+} TileDef;
+
+// appearance comes from tileDefs by type, so a tile is just the type and TILE_STATE_* bits
+typedef struct {
+    uint8_t type;
+    uint8_t state;
 } Tile;
 
+// sparse per-tile appearance changes, e.g. tinted corridors; open addressing keyed by tile index,
+// only looked up for tiles with TILE_STATE_OVERRIDE
+typedef struct {
+    int* keys; // tile index, -1 for empty slots
+    Color* fgColors;
+    size_t capacity; // power of two
+    size_t count;
+} TileOverrides;
+
+// exploration state of a square of tiles, allocated once any of them is visited
+typedef struct {
+    uint64_t visited[EXPLORED_CHUNK_SIZE]; // bit x of word y
+    uint8_t remembered[EXPLORED_CHUNK_SIZE * EXPLORED_CHUNK_SIZE]; // tile type when last in LOS
+} ExploredChunk;
+
+typedef struct {
+    ExploredChunk** chunks; // chunksWidth * chunksHeight, NULL while unexplored
+    int chunksWidth;
+    int chunksHeight;
+    size_t chunksCount; // allocated ones
+} ExploredMap;
+
+// tiles whose appearance changed since the active renderer last drew them
+typedef struct {
+    uint64_t* bits; // one bit per tile, set while the tile is listed
+    int* tiles; // indices (y * width + x) of dirty tiles
+    size_t count;
+    size_t capacity;
+    bool all; // everything changed, e.g. a new map
+} DirtyTiles;
+
+// indices of tiles set in LOS since the last clearLOS, so clearing touches only those
+typedef struct {
+    int* tiles;
+    size_t count;
+    size_t capacity;
+} LOSTiles;
+
 typedef struct {
     int width;
     int height;
-    Tile** tiles;
+    Tile* tiles; // y * width + x
+    LOSTiles los;
+    TileOverrides overrides;
+    ExploredMap explored;
+    DirtyTiles dirty;
+    size_t roomsCount;
+    Coord stairsUp; // -1, -1 on the first level
+    Coord stairsDown;
+    int* walkable; // indices (y * width + x) of every passable tile, for O(1) random picks
+    size_t walkableCount;
 } Map;
 
+// tunables of every generator, defaults are the MAP_GENERATOR_* / ROOM_* / BSP_* / CAVE_* macros
 typedef struct {
-    Vector2 position;
+    int bordersPadding;
+    int stepsPercent;
+    int directionChangeChance;
+    int roomChance;
+    int roomCooldown;
+    int roomMinWidth;
+    int roomMaxWidth;
+    int roomMinHeight;
+    int roomMaxHeight;
+    int bspMinLeafSize;
+    int bspRoomPadding;
+    int caveInitialWallChance;
+    int caveIterationsCount;
+} MapGeneratorParams;
+
+// carves floor into an all-wall map; borders, connectivity and stairs are handled by buildMap
+typedef struct {
+    const char* name;
+    size_t (*generate) (Map* map, Rng* rng, const MapGeneratorParams* params); // returns the rooms count
+} MapGenerator;
+
+typedef struct {
+    uint64_t seed;
+    const char* generator;
+    int width;
+    int height;
+    int regionsCount; // before connectivity repair
+    size_t roomsCount;
+    size_t floorCount;
+    size_t wallCount;
+    size_t corridorCount;
+    double generationTime;
+} MapStats;
+
+typedef struct {
+    const char* csvPath;
+    uint64_t firstSeed;
+    int seedsCount;
+    int threadsCount;
+    MapGenerator* generator; // NULL for the first level's generator
+    int width;
+    int height;
+    MapStats* stats; // one per seed
+} MapGenerationBatch;
+
+typedef struct {
+    MapGenerationBatch* batch;
+    int threadIndex;
+} MapGenerationWorker;
+
+// a level built on a background thread into its own map, swapped in by the main thread
+typedef struct {
+    pthread_t thread;
+    bool running; // started and not joined yet
+    atomic_bool done;
+    bool ready; // joined, map holds the level for seed and depth
+    uint64_t seed;
+    int depth;
+    Map map;
+    Rng rng; // state after generation, the game's rng continues from it
+    Coord spawn;
+    bool ok;
+    double startTime;
+} LevelGeneration;
+
+// indexed by tile type; flags are duplicated into a byte array so hot checks are a single load
+TileDef tileDefs[TILE_TYPES_MAX_COUNT];
+uint8_t tileFlags[TILE_TYPES_MAX_COUNT];
+int tileDefsCount;
+
+MapGeneratorParams mapGeneratorParams = {
+    MAP_GENERATOR_BORDERS_PADDING, MAP_GENERATOR_STEPS_PERCENT, MAP_GENERATOR_STEP_DIRECTION_CHANGE_CHANCE,
+    MAP_GENERATOR_STEP_ROOM_CHANCE, MAP_GENERATOR_STEP_ROOM_COOLDOWN,
+    ROOM_MIN_WIDTH, ROOM_MAX_WIDTH, ROOM_MIN_HEIGHT, ROOM_MAX_HEIGHT,
+    BSP_MIN_LEAF_SIZE, BSP_ROOM_PADDING, CAVE_INITIAL_WALL_CHANCE, CAVE_ITERATIONS_COUNT,
+};
+
+typedef struct {
+    Vector2 position; // world position of the screen's top left corner
     Vector2 target;
+    float zoom; // screen pixels per world unit
 } GameCamera;
 
 typedef struct {
+    char* filepath;
+    bool loaded;
     Font font;
     int size;
     int spacing;
 } GameFont;
 
 typedef struct {
-    char* text;
+    uint32_t magic;
+    uint32_t version;
+    int baseSize;
+    int glyphCount;
+    int glyphPadding;
+    int width;
+    int height;
+    int format;
+    int pixelsSize;
+} FontAtlasCacheHeader;
+
+typedef struct {
+    char text[128]; // copied, TextFormat buffers are reused within a frame
     Color color;
 } DebugInfoLine;
 
@@ -109,6 +390,67 @@ typedef struct {
     DebugInfo debugInfo;
 } UI;
 
+typedef struct {
+    int visionRadius;
+    int halfRadius;
+    int raysCount;
+    int wordsCount; // 64-bit words per ray mask
+    int cellsCount;
+    Coord* cellOffsets; // box cells in the order they are walked
+    int* cellIndices; // box position -> index into cellOffsets
+    uint64_t* cellRays; // rays passing through each cell, wordsCount masks per cell
+} FovTable;
+
+// tiles that became visited while tracking is on, for the run stop checks
+typedef struct {
+    bool tracking;
+    Coord* tiles;
+    size_t count;
+    size_t capacity;
+} RevealedTiles;
+
+// auto-explore path being walked, kept between commands
+typedef struct {
+    bool active;
+    size_t actorsInSight;
+    Coord* path;
+    int pathLength;
+    int pathStep;
+} AutoExplore;
+
+typedef struct {
+    int index; // y * width + x
+    uint16_t rgb[3];
+} LightCell;
+
+// light area is computed with the fov tables; the cells it added to the light buffer are kept
+// so it can be taken out again without recomputing the old area
+typedef struct {
+    Coord coord;
+    Color color;
+    int radius;
+    bool dirty; // new or moved, relit by updateLighting
+    LightCell* cells;
+    size_t cellsCount;
+    size_t cellsCapacity;
+} Light;
+
+typedef struct {
+    uint16_t rgb[LIGHT_CHUNK_SIZE * LIGHT_CHUNK_SIZE][3];
+} LightChunk;
+
+typedef struct {
+    bool enabled;
+    Light* lights;
+    size_t lightsCount;
+    size_t lightsCapacity;
+    size_t playerLight;
+    Light* current; // light being computed, for the fov plot callback
+    LightChunk** chunks; // chunksWidth * chunksHeight, NULL until lit
+    int chunksWidth;
+    int chunksHeight;
+} Lighting;
+
 typedef struct {
 
     int windowWidth;
@@ -124,6 +466,26 @@ typedef struct {
 
     Map map;
 
+    FovTable fovTables[FOV_TABLES_MAX_COUNT];
+    size_t fovTablesCount;
+
+    uint64_t seed; // dungeon seed, every level is generated from it and its depth
+    Rng rng;
+
+    int depth;
+    LevelCache levelCache;
+
+    LevelGeneration generation;
+    bool levelPending; // depth is still being generated, commands wait for it
+    bool levelPendingDescending;
+
+    InputRecording recording;
+
+    Lighting lighting;
+
+    RevealedTiles revealed;
+    AutoExplore autoExplore;
+
     Actor player;
     Actor actors[1024];
     size_t actors_count;
@@ -140,31 +502,266 @@ typedef struct {
 
 } Game;
 
-GameFont createGameFont(char* filepath, int size) {
+// rendering and input backend, main loop is shared between raylib window and terminal
+typedef struct Renderer Renderer;
+
+struct Renderer {
+    const char* name;
+    void* data;
+    bool (*init) (Renderer* renderer, Game* game);
+    void (*shutdown) (Renderer* renderer, Game* game);
+    bool (*shouldClose) (Renderer* renderer, Game* game);
+    Command (*pollInput) (Renderer* renderer, Game* game, bool* repeated);
+    void (*renderFrame) (Renderer* renderer, Game* game);
+};
+
+typedef struct {
+    RenderTexture2D mapLayer; // map tiles as of the last frame, in screen space
+    Vector2 mapLayerCamera;
+    float mapLayerZoom;
+    bool mapLayerValid;
+    Texture2D minimap; // one pixel per map tile, also the zoomed out level of detail
+    bool minimapValid;
+    bool minimapVisible;
+    Color* minimapPixels; // staging rows for texture uploads
+    bool focused; // camera follows focus instead of the player until the player moves
+    Vector2 focus;
+    Coord focusPlayerCoord;
+} RaylibRenderer;
+
+typedef struct {
+    char ch;
+    Color fgColor;
+    Color bgColor;
+} TerminalCell;
 
-    int codepoints[512] = { 0 };
+typedef struct {
+    int width;
+    int height;
+    TerminalCell* front; // what the terminal currently shows
+    TerminalCell* back; // what this frame wants to show
+    Coord origin; // map coordinate of the top left cell
+    bool backValid;
+    char status[256];
+    char* output;
+    size_t outputSize;
+    size_t outputCapacity;
+    bool quit;
+    double lastFrameTime;
+} TerminalRenderer;
+
+#ifndef _WIN32
+// kept outside the renderer so exit and signal handlers can restore the terminal
+struct termios terminalSavedAttributes;
+volatile sig_atomic_t terminalRawMode;
+#endif
+
+void fillFontCodepoints(int* codepoints) {
     for (int i = 0; i < 95; i++) codepoints[i] = 32 + i;   // Basic ASCII characters
-    for (int i = 0; i < 255; i++) codepoints[96 + i] = 0x0400 + i;   // Cyrillic characters
+    for (int i = 0; i < 256; i++) codepoints[95 + i] = 0x0400 + i;   // Cyrillic characters
+}
+
+uint32_t fnv1a(uint32_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// cache files sit next to the font, keyed by size, codepoint set and font file modification time
+const char* fontAtlasCachePath(GameFont* font, int* codepoints) {
+
+    uint32_t version = FONT_ATLAS_CACHE_VERSION;
+    long modTime = GetFileModTime(font->filepath);
+
+    uint32_t hash = 2166136261u;
+    hash = fnv1a(hash, &version, sizeof(version));
+    hash = fnv1a(hash, &modTime, sizeof(modTime));
+    hash = fnv1a(hash, codepoints, FONT_CODEPOINTS_COUNT * sizeof(int));
+
+    return TextFormat("%s.%d-%08x.atlas", font->filepath, font->size, hash);
+
+}
+
+bool loadFontAtlasCache(const char* path, Font* font) {
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    FontAtlasCacheHeader header = {0};
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+              && header.magic == FONT_ATLAS_CACHE_MAGIC
+              && header.version == FONT_ATLAS_CACHE_VERSION
+              && header.glyphCount > 0
+              && header.pixelsSize == GetPixelDataSize(header.width, header.height, header.format);
+
+    Font f = {0};
+    Image image = {0};
+
+    if (ok) {
+
+        f.baseSize = header.baseSize;
+        f.glyphCount = header.glyphCount;
+        f.glyphPadding = header.glyphPadding;
+        f.recs = RL_MALLOC(f.glyphCount * sizeof(Rectangle));
+        f.glyphs = RL_CALLOC(f.glyphCount, sizeof(GlyphInfo));
+
+        image.width = header.width;
+        image.height = header.height;
+        image.format = header.format;
+        image.mipmaps = 1;
+        image.data = RL_MALLOC(header.pixelsSize);
+
+        ok = fread(f.recs, sizeof(Rectangle), f.glyphCount, file) == (size_t) f.glyphCount;
+
+        for (int i = 0; ok && i < f.glyphCount; ++i) {
+            int metrics[4];
+            ok = fread(metrics, sizeof(metrics), 1, file) == 1;
+            f.glyphs[i].value = metrics[0];
+            f.glyphs[i].offsetX = metrics[1];
+            f.glyphs[i].offsetY = metrics[2];
+            f.glyphs[i].advanceX = metrics[3];
+        }
+
+        ok = ok && fread(image.data, header.pixelsSize, 1, file) == 1;
+
+    }
+
+    fclose(file);
+
+    if (!ok) {
+        printf("WARNING: ignoring invalid font atlas cache %s\n", path);
+        RL_FREE(f.recs);
+        RL_FREE(f.glyphs);
+        RL_FREE(image.data);
+        return false;
+    }
+
+    f.texture = LoadTextureFromImage(image);
+    UnloadImage(image);
+
+    *font = f;
+    return true;
+
+}
+
+void saveFontAtlasCache(const char* path, Font* font) {
+
+    Image image = LoadImageFromTexture(font->texture);
+
+    FontAtlasCacheHeader header = {0};
+    header.magic = FONT_ATLAS_CACHE_MAGIC;
+    header.version = FONT_ATLAS_CACHE_VERSION;
+    header.baseSize = font->baseSize;
+    header.glyphCount = font->glyphCount;
+    header.glyphPadding = font->glyphPadding;
+    header.width = image.width;
+    header.height = image.height;
+    header.format = image.format;
+    header.pixelsSize = GetPixelDataSize(image.width, image.height, image.format);
+
+    FILE* file = fopen(path, "wb");
+
+    if (file != NULL) {
+
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(font->recs, sizeof(Rectangle), font->glyphCount, file);
+
+        for (int i = 0; i < font->glyphCount; ++i) {
+            GlyphInfo g = font->glyphs[i];
+            int metrics[4] = {g.value, g.offsetX, g.offsetY, g.advanceX};
+            fwrite(metrics, sizeof(metrics), 1, file);
+        }
+
+        fwrite(image.data, header.pixelsSize, 1, file);
+        fclose(file);
+
+    } else printf("WARNING: can't write font atlas cache %s\n", path);
+
+    UnloadImage(image);
+
+}
+
+// removes atlases of the same font and size built for another codepoint set or font version
+void pruneFontAtlasCache(GameFont* font, const char* currentPath) {
+
+    char prefix[512];
+    snprintf(prefix, sizeof(prefix), "%s.%d-", GetFileName(font->filepath), font->size);
+
+    FilePathList files = LoadDirectoryFilesEx(GetDirectoryPath(font->filepath), ".atlas", false);
+
+    for (unsigned int i = 0; i < files.count; ++i) {
+        const char* name = GetFileName(files.paths[i]);
+        if (strncmp(name, prefix, strlen(prefix)) != 0 || strcmp(name, GetFileName(currentPath)) == 0) continue;
+        if (remove(files.paths[i]) != 0) printf("WARNING: can't remove stale font atlas cache %s\n", files.paths[i]);
+    }
+
+    UnloadDirectoryFiles(files);
+
+}
+
+void loadGameFont(GameFont* font) {
+
+    font->loaded = true;
+
+    if (!FileExists(font->filepath)) {
+        printf("WARNING: font %s not found, using default font\n", font->filepath);
+        font->font = GetFontDefault();
+        return;
+    }
+
+    int codepoints[FONT_CODEPOINTS_COUNT];
+    fillFontCodepoints(codepoints);
+
+    char cachePath[1024];
+    snprintf(cachePath, sizeof(cachePath), "%s", fontAtlasCachePath(font, codepoints));
+
+    if (!loadFontAtlasCache(cachePath, &font->font)) {
+
+        font->font = LoadFontEx(font->filepath, font->size, codepoints, FONT_CODEPOINTS_COUNT);
+
+        // on failure raylib hands back its default font, which must not be cached as this one
+        if (font->font.texture.id == GetFontDefault().texture.id) {
+            printf("WARNING: can't load font %s, using default font\n", font->filepath);
+            return;
+        }
+
+        pruneFontAtlasCache(font, cachePath);
+        saveFontAtlasCache(cachePath, &font->font);
+
+    }
+
+    SetTextureFilter(font->font.texture, TEXTURE_FILTER_POINT);
+
+}
+
+// fonts are loaded lazily on first use
+GameFont createGameFont(char* filepath, int size) {
 
     GameFont font = {0};
 
-    font.font = LoadFontEx(filepath, size, codepoints, 512);
+    font.filepath = filepath;
     font.size = size;
     font.spacing = 1;
 
-    SetTextureFilter(font.font.texture, TEXTURE_FILTER_POINT);
-
     return font;
 
 }
 
+Font* gameFontGet(GameFont* font) {
+    if (!font->loaded) loadGameFont(font);
+    return &font->font;
+}
+
 void renderText(GameFont* font, const char* text, Vector2 position, Color color) {
-    DrawTextEx(font->font, text, position, font->size, font->spacing, color);
+    DrawTextEx(*gameFontGet(font), text, position, font->size, font->spacing, color);
 }
 
 Vector2 renderTextBg(GameFont* font, const char* text, Vector2 position, Color fgColor, Color bgColor) {
 
-    Vector2 textSize = MeasureTextEx(font->font, text, font->size, font->spacing);
+    Vector2 textSize = MeasureTextEx(*gameFontGet(font), text, font->size, font->spacing);
 
     DrawRectangleV(position, textSize, bgColor);
     renderText(font, text, position, fgColor);
@@ -177,16 +774,20 @@ Vector2 coord2vector(Game* game, Coord coord) {
     return (Vector2) {coord.x * game->cellSize, coord.y * game->cellSize};
 }
 
-Vector2 coord2screen(Game* game, Coord coord) {
-    return Vector2Subtract(coord2vector(game, coord), game->camera.position);
+Vector2 vector2screen(Game* game, Vector2 vector) {
+    return Vector2Scale(Vector2Subtract(vector, game->camera.position), game->camera.zoom);
 }
 
-Vector2 vector2screen(Game* game, Vector2 vector) {
-    return Vector2Subtract(vector, game->camera.position);
+Vector2 coord2screen(Game* game, Coord coord) {
+    return vector2screen(game, coord2vector(game, coord));
 }
 
 Vector2 screen2vector(Game* game, Vector2 screen) {
-    return Vector2Add(screen, game->camera.position);
+    return Vector2Add(Vector2Scale(screen, 1.0f / game->camera.zoom), game->camera.position);
+}
+
+float screenCellSize(Game* game) {
+    return game->cellSize * game->camera.zoom;
 }
 
 Coord vector2coord(Game* game, Vector2 vector) {
@@ -198,139 +799,596 @@ Coord screen2coord(Game* game, Vector2 screen) {
 }
 
 void cameraPosition(Game* game, Vector2 position) {
-    Vector2 halfWindowSize = {(float) game->windowWidth / 2, (float) game->windowHeight / 2};
+    Vector2 halfWindowSize = {(float) game->windowWidth / 2 / game->camera.zoom, (float) game->windowHeight / 2 / game->camera.zoom};
     game->camera.position = Vector2Subtract(position, halfWindowSize);
     game->camera.target = game->camera.position;
 }
 
 void cameraTarget(Game* game, Vector2 target) {
-    Vector2 halfWindowSize = {(float) game->windowWidth / 2, (float) game->windowHeight / 2};
+    Vector2 halfWindowSize = {(float) game->windowWidth / 2 / game->camera.zoom, (float) game->windowHeight / 2 / game->camera.zoom};
     game->camera.target = Vector2Subtract(target, halfWindowSize);
 }
 
+// keeps the world point at the window center in place
+void cameraZoom(Game* game, float factor) {
+
+    float zoom = Clamp(game->camera.zoom * factor, CAMERA_ZOOM_MIN, CAMERA_ZOOM_MAX);
+    Vector2 halfWindowSize = {(float) game->windowWidth / 2, (float) game->windowHeight / 2};
+
+    Vector2 center = screen2vector(game, halfWindowSize);
+    Vector2 targetCenter = Vector2Add(game->camera.target, Vector2Scale(halfWindowSize, 1.0f / game->camera.zoom));
+
+    game->camera.zoom = zoom;
+    game->camera.position = Vector2Subtract(center, Vector2Scale(halfWindowSize, 1.0f / zoom));
+    game->camera.target = Vector2Subtract(targetCenter, Vector2Scale(halfWindowSize, 1.0f / zoom));
+
+}
+
 void cameraUpdate(Game* game) {
     game->camera.position = Vector2Lerp(game->camera.position, game->camera.target, LERPING_FACTOR(0.05f));
+    // snap once close enough, so a settled camera lets the cached map layer be reused
+    if (Vector2Distance(game->camera.position, game->camera.target) < CAMERA_SNAP_DISTANCE)
+        game->camera.position = game->camera.target;
 }
 
-Tile createTile(TileType type) {
-    Tile t = {0};
-    t.type = type;
-    t.glyph.fgColor = WHITE;
-    t.glyph.bgColor = BLACK;
-    t.glyph.animateMovement = false;
-
-    switch(type) {
-    case TileTypeWall:
-        t.glyph.ch = '#';
-        break;
-    case TileTypeFloor:
-        t.glyph.ch = '.';
-        break;
-    default:
-        break;
-    }
-
-    return t;
+// splitmix64, so map generation and replays don't depend on raylib's random generator
+void rngSeed(Rng* rng, uint64_t seed) {
+    rng->state = seed;
 }
 
-bool checkMapBounds(Map* map, int x, int y) {
-    return x >= 0 && x < map->width && y >= 0 && y < map->height;
+uint64_t rngNext(Rng* rng) {
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
 }
 
-Tile* mapGetTile(Map* map, int x, int y) {
-    return &(map->tiles[y][x]);
+// inclusive on both ends, like GetRandomValue
+int rngRange(Rng* rng, int min, int max) {
+    if (min > max) {
+        int t = min;
+        min = max;
+        max = t;
+    }
+    return min + (int) (rngNext(rng) % ((uint64_t) max - min + 1));
 }
 
-bool isTileBlocksLOS(Tile* tile) {
-    switch (tile->type) {
-    case TileTypeWall:
-        return true;
-    default:
-        return false;
-    }
+bool colorEquals(Color a, Color b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
 }
 
-bool isTileBlocksMovement(Tile* tile) {
-    switch (tile->type) {
-    case TileTypeWall:
-        return true;
-    default:
-        return false;
-    }
+Tile createTile(TileType type) {
+    return (Tile) {type, 0};
 }
 
-void clearLOS(Game* game) {
-    for (int y = 0; y < game->map.height; ++y)
-        for (int x = 0; x < game->map.width; ++x)
-            mapGetTile(&game->map, x, y)->isInLOS = false;
+void setTileDef(int type, const char* key, char ch, Color fgColor, Color bgColor, uint8_t flags, const char* name) {
+
+    TileDef* def = &tileDefs[type];
+
+    snprintf(def->key, sizeof(def->key), "%s", key);
+    snprintf(def->name, sizeof(def->name), "%s", name);
+    def->ch = ch;
+    def->fgColor = fgColor;
+    def->bgColor = bgColor;
+    def->flags = flags;
+
+    tileFlags[type] = flags;
+
+    if (type >= tileDefsCount) tileDefsCount = type + 1;
+
 }
 
-bool plot(Game* game, int x, int y) {
+// used when the definitions file is missing, so the generator's tiles always exist
+void initDefaultTileDefs() {
 
-    if (x < 0 || x >= game->map.width || y < 0 || y >= game->map.height)
-        return false;
+    for (int i = 0; i < TILE_TYPES_MAX_COUNT; ++i) setTileDef(i, "", 0, WHITE, BLACK, 0, "<Unknown>");
+    tileDefsCount = TileTypesBuiltinCount;
 
-    bool isVisible = !isTileBlocksLOS(mapGetTile(&game->map, x, y));
+    uint8_t blocksAll = TILE_FLAG_BLOCKS_LOS | TILE_FLAG_BLOCKS_MOVEMENT;
 
-    if (isVisible)
-        for (int xx = -1; xx <= 1; xx++)
-            for (int yy = -1; yy <= 1; yy++)
-                if (x + xx >= 0 && x + xx < game->map.width
-                    && y + yy >= 0 && y + yy < game->map.height) {
+    setTileDef(TileTypeEmpty, "empty", 0, WHITE, BLACK, 0, "Empty");
+    setTileDef(TileTypeWall, "wall", '#', WHITE, BLACK, blocksAll, "Wall");
+    setTileDef(TileTypeFloor, "floor", '.', DARKGRAY, BLACK, 0, "Floor");
+    setTileDef(TileTypeStairsDown, "stairs_down", '>', WHITE, BLACK, 0, "Stairs down");
+    setTileDef(TileTypeStairsUp, "stairs_up", '<', WHITE, BLACK, 0, "Stairs up");
 
-                    int tileX = x + xx;
-                    int tileY = y + yy;
+}
 
-                    Tile* t = mapGetTile(&game->map, tileX, tileY);
-                    t->isInLOS = true;
-                    t->isVisited = true;
+int findTileType(const char* key) {
+    for (int i = 0; i < tileDefsCount; ++i)
+        if (strcmp(tileDefs[i].key, key) == 0) return i;
+    return -1;
+}
 
-                }
+bool parseHexColor(const char* text, Color* color) {
 
-    return isVisible;
+    unsigned int rgb;
+    if (strlen(text) != 6 || sscanf(text, "%6x", &rgb) != 1) return false;
+
+    *color = (Color) {(rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF, 255};
+    return true;
 
 }
 
-bool alwaysTruePlot(Game* game, int x, int y) {
+bool parseTileFlags(char* text, uint8_t* flags) {
 
-    Tile* t = mapGetTile(&game->map, x, y);
-    t->isInLOS = true;
-    t->isVisited = true;
+    *flags = 0;
+    if (strcmp(text, "-") == 0) return true;
+
+    for (char* flag = strtok(text, ","); flag != NULL; flag = strtok(NULL, ",")) {
+        if (strcmp(flag, "blocks_los") == 0) *flags |= TILE_FLAG_BLOCKS_LOS;
+        else if (strcmp(flag, "blocks_movement") == 0) *flags |= TILE_FLAG_BLOCKS_MOVEMENT;
+        else return false;
+    }
 
     return true;
 
 }
 
-void bresenham(Game* game, int x1, int y1, int x2, int y2, bool (*plot) (Game* game, int x, int y)) {
+// overrides the defaults with the definitions file, see assets/data/tiles.txt for the format
+void loadTileDefs(const char* path) {
 
-    int dx = x2 - x1;
-    int ix = dx > 0 ? 1 : -1;
-    dx = 2 * abs(dx);
+    initDefaultTileDefs();
 
-    int dy = y2 - y1;
-    int iy = dy > 0 ? 1 : -1;
-    dy = 2 * abs(dy);
+    FILE* file = fopen(path, "r");
 
-    if (!plot(game, x1, y1)) return;
+    if (file == NULL) {
+        printf("WARNING: tile definitions %s not found, using built-in tiles\n", path);
+        return;
+    }
 
-    if (dx >= dy) {
-        int error = dy - dx / 2;
+    char line[512];
+    int lineNumber = 0;
 
-        while (x1 != x2) {
-            if (error > 0 || (error == 0 && ix > 0)) {
-                error = error - dx;
-                y1 = y1 + iy;
-            }
+    while (fgets(line, sizeof(line), file) != NULL) {
 
-            error = error + dy;
-            x1 = x1 + ix;
+        lineNumber++;
 
-            if (!plot(game, x1, y1)) return;
-        }
-    } else {
-        int error = dx - dy / 2;
+        char key[32], glyph[16], fg[16], bg[16], flagsText[128], name[64];
+        if (line[0] == '#' || sscanf(line, "%31s", key) != 1) continue;
 
-        while (y1 != y2) {
+        Color fgColor, bgColor;
+        uint8_t flags;
+
+        if (sscanf(line, "%31s %15s %15s %15s %127s %63[^\r\n]", key, glyph, fg, bg, flagsText, name) != 6
+            || !parseHexColor(fg, &fgColor) || !parseHexColor(bg, &bgColor) || !parseTileFlags(flagsText, &flags)) {
+            printf("WARNING: %s:%d: invalid tile definition\n", path, lineNumber);
+            continue;
+        }
+
+        char ch = glyph[0];
+        if (strcmp(glyph, "space") == 0) ch = ' ';
+        else if (strcmp(glyph, "none") == 0) ch = 0;
+
+        int type = findTileType(key);
+        if (type < 0) type = tileDefsCount;
+
+        if (type >= TILE_TYPES_MAX_COUNT) {
+            printf("WARNING: %s:%d: too many tile types\n", path, lineNumber);
+            continue;
+        }
+
+        setTileDef(type, key, ch, fgColor, bgColor, flags, name);
+
+    }
+
+    fclose(file);
+
+}
+
+bool checkMapBounds(Map* map, int x, int y) {
+    return x >= 0 && x < map->width && y >= 0 && y < map->height;
+}
+
+Tile* mapGetTile(Map* map, int x, int y) {
+    return &map->tiles[y * map->width + x];
+}
+
+bool isTileInLOS(Tile* tile) {
+    return tile->state & TILE_STATE_IN_LOS;
+}
+
+// whole map passes work on the contiguous tile array: fills are block copies, and state scans
+// test 4 two-byte tiles per 64-bit word
+
+void fillTiles(Tile* tiles, size_t count, Tile tile) {
+
+    size_t block = count < MAP_FILL_BLOCK_TILES ? count : MAP_FILL_BLOCK_TILES;
+
+    for (size_t i = 0; i < block; ++i) tiles[i] = tile;
+
+    for (size_t filled = block; filled < count; filled += block) {
+        size_t n = count - filled < block ? count - filled : block;
+        memcpy(&tiles[filled], tiles, n * sizeof(Tile));
+    }
+
+}
+
+void fillMap(Map* map, TileType type) {
+    fillTiles(map->tiles, (size_t) map->width * map->height, createTile(type));
+}
+
+// touches only the border tiles instead of testing every tile
+void fillMapBorder(Map* map, TileType type) {
+
+    Tile tile = createTile(type);
+    int width = map->width;
+
+    fillTiles(map->tiles, width, tile);
+    fillTiles(&map->tiles[(size_t) (map->height - 1) * width], width, tile);
+
+    for (int y = 1; y < map->height - 1; ++y) {
+        map->tiles[(size_t) y * width] = tile;
+        map->tiles[(size_t) y * width + width - 1] = tile;
+    }
+
+}
+
+// the state bits repeated in all four tiles of a word, independent of byte order
+uint64_t tileStateWordMask(uint8_t state) {
+    Tile tile = {0, state};
+    uint16_t bits;
+    memcpy(&bits, &tile, sizeof(bits));
+    return bits * 0x0001000100010001ull;
+}
+
+// number of tiles with any of the state bits set, four tiles per word: adding 0x7fff to the low
+// 15 bits of a lane carries into its top bit when they are nonzero, the multiply then sums the top bits
+size_t countTilesWithState(Map* map, uint8_t state) {
+
+    size_t count = (size_t) map->width * map->height;
+    uint64_t mask = tileStateWordMask(state);
+    const uint64_t low = 0x7FFF7FFF7FFF7FFFull;
+
+    size_t total = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        uint64_t word;
+        memcpy(&word, &map->tiles[i], sizeof(word));
+        word &= mask;
+        uint64_t nonzero = (((word & low) + low) | word) & ~low;
+        total += ((nonzero >> 15) * 0x0001000100010001ull) >> 48;
+    }
+
+    for (; i < count; ++i) total += (map->tiles[i].state & state) != 0;
+
+    return total;
+
+}
+
+// counts per tile type, spread over four tables so runs of one type don't serialize on one counter
+void mapTypeHistogram(Map* map, size_t counts[TILE_TYPES_MAX_COUNT]) {
+
+    size_t partial[4][TILE_TYPES_MAX_COUNT] = {0};
+    size_t count = (size_t) map->width * map->height;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        partial[0][map->tiles[i].type]++;
+        partial[1][map->tiles[i + 1].type]++;
+        partial[2][map->tiles[i + 2].type]++;
+        partial[3][map->tiles[i + 3].type]++;
+    }
+
+    for (; i < count; ++i) partial[0][map->tiles[i].type]++;
+
+    for (int t = 0; t < TILE_TYPES_MAX_COUNT; ++t) counts[t] = partial[0][t] + partial[1][t] + partial[2][t] + partial[3][t];
+
+}
+
+ExploredChunk* getExploredChunk(Map* map, int x, int y) {
+    return map->explored.chunks[(y / EXPLORED_CHUNK_SIZE) * map->explored.chunksWidth + x / EXPLORED_CHUNK_SIZE];
+}
+
+bool isTileVisited(Map* map, int x, int y) {
+    ExploredChunk* chunk = getExploredChunk(map, x, y);
+    return chunk != NULL && (chunk->visited[y % EXPLORED_CHUNK_SIZE] >> (x % EXPLORED_CHUNK_SIZE) & 1);
+}
+
+// marks the tile visited and remembers its current type
+void setTileVisited(Map* map, int x, int y) {
+
+    ExploredChunk** chunk = &map->explored.chunks[(y / EXPLORED_CHUNK_SIZE) * map->explored.chunksWidth + x / EXPLORED_CHUNK_SIZE];
+
+    if (*chunk == NULL) {
+        *chunk = calloc(1, sizeof(ExploredChunk));
+        map->explored.chunksCount++;
+    }
+
+    (*chunk)->visited[y % EXPLORED_CHUNK_SIZE] |= (uint64_t) 1 << (x % EXPLORED_CHUNK_SIZE);
+
+    (*chunk)->remembered[(y % EXPLORED_CHUNK_SIZE) * EXPLORED_CHUNK_SIZE + x % EXPLORED_CHUNK_SIZE] = mapGetTile(map, x, y)->type;
+
+}
+
+void clearExploredMap(Map* map) {
+
+    ExploredMap* explored = &map->explored;
+
+    for (int i = 0; i < explored->chunksWidth * explored->chunksHeight; ++i) {
+        free(explored->chunks[i]);
+        explored->chunks[i] = NULL;
+    }
+
+    explored->chunksCount = 0;
+
+}
+
+// visits the part of every explored chunk inside the inclusive tile rectangle, skipping
+// unexplored chunks entirely; rectangles are inclusive too
+void forEachExploredChunk(Map* map, Coord from, Coord to, void (*visit) (void* data, int x0, int y0, int x1, int y1), void* data) {
+
+    for (int cy = from.y / EXPLORED_CHUNK_SIZE; cy <= to.y / EXPLORED_CHUNK_SIZE; ++cy) {
+        for (int cx = from.x / EXPLORED_CHUNK_SIZE; cx <= to.x / EXPLORED_CHUNK_SIZE; ++cx) {
+
+            if (map->explored.chunks[cy * map->explored.chunksWidth + cx] == NULL) continue;
+
+            int x0 = cx * EXPLORED_CHUNK_SIZE, y0 = cy * EXPLORED_CHUNK_SIZE;
+            int x1 = x0 + EXPLORED_CHUNK_SIZE - 1, y1 = y0 + EXPLORED_CHUNK_SIZE - 1;
+
+            visit(data, x0 > from.x ? x0 : from.x, y0 > from.y ? y0 : from.y, x1 < to.x ? x1 : to.x, y1 < to.y ? y1 : to.y);
+
+        }
+    }
+
+}
+
+size_t tileOverrideSlot(TileOverrides* overrides, int index) {
+
+    size_t slot = ((uint32_t) index * 2654435761u) & (overrides->capacity - 1);
+    while (overrides->keys[slot] != -1 && overrides->keys[slot] != index) slot = (slot + 1) & (overrides->capacity - 1);
+
+    return slot;
+
+}
+
+void clearTileOverrides(TileOverrides* overrides) {
+    for (size_t i = 0; i < overrides->capacity; ++i) overrides->keys[i] = -1;
+    overrides->count = 0;
+}
+
+void growTileOverrides(TileOverrides* overrides) {
+
+    TileOverrides old = *overrides;
+
+    overrides->capacity = old.capacity ? old.capacity * 2 : MAP_TILE_OVERRIDES_MIN_CAPACITY;
+    overrides->keys = malloc(overrides->capacity * sizeof(int));
+    overrides->fgColors = malloc(overrides->capacity * sizeof(Color));
+    clearTileOverrides(overrides);
+
+    for (size_t i = 0; i < old.capacity; ++i) {
+        if (old.keys[i] == -1) continue;
+        size_t slot = tileOverrideSlot(overrides, old.keys[i]);
+        overrides->keys[slot] = old.keys[i];
+        overrides->fgColors[slot] = old.fgColors[i];
+        overrides->count++;
+    }
+
+    free(old.keys);
+    free(old.fgColors);
+
+}
+
+// entries of tiles replaced since are left in place, the state bit decides whether they apply
+void setTileOverride(Map* map, int x, int y, Color fgColor) {
+
+    TileOverrides* overrides = &map->overrides;
+    if ((overrides->count + 1) * 4 > overrides->capacity * 3) growTileOverrides(overrides);
+
+    int index = y * map->width + x;
+    size_t slot = tileOverrideSlot(overrides, index);
+
+    if (overrides->keys[slot] == -1) {
+        overrides->keys[slot] = index;
+        overrides->count++;
+    }
+
+    overrides->fgColors[slot] = fgColor;
+    mapGetTile(map, x, y)->state |= TILE_STATE_OVERRIDE;
+
+}
+
+Color getTileFgColor(Map* map, int x, int y) {
+
+    Tile* t = mapGetTile(map, x, y);
+    if (!(t->state & TILE_STATE_OVERRIDE)) return tileDefs[t->type].fgColor;
+
+    return map->overrides.fgColors[tileOverrideSlot(&map->overrides, y * map->width + x)];
+
+}
+
+Glyph getTileGlyph(Map* map, int x, int y) {
+
+    Glyph glyph = {0};
+    TileDef* def = &tileDefs[mapGetTile(map, x, y)->type];
+
+    glyph.ch = def->ch;
+    glyph.fgColor = getTileFgColor(map, x, y);
+    glyph.bgColor = def->bgColor;
+
+    return glyph;
+
+}
+
+// what the player knows of a visited tile: current while in LOS, the remembered type otherwise
+Glyph getSeenTileGlyph(Map* map, int x, int y) {
+
+    Tile* t = mapGetTile(map, x, y);
+    ExploredChunk* chunk = getExploredChunk(map, x, y);
+
+    if (isTileInLOS(t) || chunk == NULL) return getTileGlyph(map, x, y);
+
+    uint8_t type = chunk->remembered[(y % EXPLORED_CHUNK_SIZE) * EXPLORED_CHUNK_SIZE + x % EXPLORED_CHUNK_SIZE];
+    if (type == t->type) return getTileGlyph(map, x, y);
+
+    TileDef* def = &tileDefs[type];
+    return (Glyph) {.ch = def->ch, .fgColor = def->fgColor, .bgColor = def->bgColor};
+
+}
+
+bool isTileBlocksLOS(Tile* tile) {
+    return tileFlags[tile->type] & TILE_FLAG_BLOCKS_LOS;
+}
+
+bool isTileBlocksMovement(Tile* tile) {
+    return tileFlags[tile->type] & TILE_FLAG_BLOCKS_MOVEMENT;
+}
+
+void markTileIndexDirty(Map* map, int i) {
+
+    DirtyTiles* dirty = &map->dirty;
+    if (dirty->all) return;
+
+    uint64_t bit = (uint64_t) 1 << (i % 64);
+
+    if (dirty->bits[i / 64] & bit) return;
+
+    if (dirty->count == dirty->capacity) {
+        dirty->all = true;
+        return;
+    }
+
+    dirty->bits[i / 64] |= bit;
+    dirty->tiles[dirty->count++] = i;
+
+}
+
+void markTileDirty(Map* map, int x, int y) {
+    markTileIndexDirty(map, y * map->width + x);
+}
+
+void markMapDirty(Map* map) {
+    map->dirty.all = true;
+}
+
+// called by the renderer once it has drawn the dirty tiles
+void clearDirtyTiles(Map* map) {
+
+    DirtyTiles* dirty = &map->dirty;
+
+    if (dirty->all) memset(dirty->bits, 0, ((size_t) map->width * map->height + 63) / 64 * sizeof(uint64_t));
+    else for (size_t i = 0; i < dirty->count; ++i) dirty->bits[dirty->tiles[i] / 64] = 0;
+
+    dirty->count = 0;
+    dirty->all = false;
+
+}
+
+// puts the tile in LOS and marks it visited
+void setTileSeen(Map* map, int x, int y) {
+
+    Tile* t = mapGetTile(map, x, y);
+
+    if (isTileInLOS(t) && isTileVisited(map, x, y)) return;
+
+    if (!isTileInLOS(t)) {
+        LOSTiles* los = &map->los;
+        if (los->count == los->capacity) {
+            los->capacity = los->capacity ? los->capacity * 2 : 1024;
+            los->tiles = realloc(los->tiles, los->capacity * sizeof(int));
+        }
+        los->tiles[los->count++] = y * map->width + x;
+    }
+
+    t->state |= TILE_STATE_IN_LOS;
+    setTileVisited(map, x, y);
+
+    markTileDirty(map, x, y);
+
+}
+
+// clears only the tiles listed as set in LOS, no full map scan
+void clearLOS(Game* game) {
+
+    Map* map = &game->map;
+
+    for (size_t i = 0; i < map->los.count; ++i) {
+        int index = map->los.tiles[i];
+        map->tiles[index].state &= ~TILE_STATE_IN_LOS;
+        markTileIndexDirty(map, index);
+    }
+
+    map->los.count = 0;
+
+}
+
+void pushRevealedTile(RevealedTiles* revealed, Coord coord) {
+
+    if (revealed->count == revealed->capacity) {
+        revealed->capacity = revealed->capacity ? revealed->capacity * 2 : 256;
+        revealed->tiles = realloc(revealed->tiles, revealed->capacity * sizeof(Coord));
+    }
+
+    revealed->tiles[revealed->count++] = coord;
+
+}
+
+bool plot(Game* game, int x, int y) {
+
+    if (x < 0 || x >= game->map.width || y < 0 || y >= game->map.height)
+        return false;
+
+    bool isVisible = !isTileBlocksLOS(mapGetTile(&game->map, x, y));
+
+    if (isVisible)
+        for (int xx = -1; xx <= 1; xx++)
+            for (int yy = -1; yy <= 1; yy++)
+                if (x + xx >= 0 && x + xx < game->map.width
+                    && y + yy >= 0 && y + yy < game->map.height) {
+
+                    int tileX = x + xx;
+                    int tileY = y + yy;
+
+                    if (game->revealed.tracking && !isTileVisited(&game->map, tileX, tileY))
+                        pushRevealedTile(&game->revealed, (Coord) {tileX, tileY});
+
+                    setTileSeen(&game->map, tileX, tileY);
+
+                }
+
+    return isVisible;
+
+}
+
+bool alwaysTruePlot(Game* game, int x, int y) {
+
+    setTileSeen(&game->map, x, y);
+
+    return true;
+
+}
+
+void traceLine(int x1, int y1, int x2, int y2, bool (*visit) (void* data, int x, int y), void* data) {
+
+    int dx = x2 - x1;
+    int ix = dx > 0 ? 1 : -1;
+    dx = 2 * abs(dx);
+
+    int dy = y2 - y1;
+    int iy = dy > 0 ? 1 : -1;
+    dy = 2 * abs(dy);
+
+    if (!visit(data, x1, y1)) return;
+
+    if (dx >= dy) {
+        int error = dy - dx / 2;
+
+        while (x1 != x2) {
+            if (error > 0 || (error == 0 && ix > 0)) {
+                error = error - dx;
+                y1 = y1 + iy;
+            }
+
+            error = error + dy;
+            x1 = x1 + ix;
+
+            if (!visit(data, x1, y1)) return;
+        }
+    } else {
+        int error = dx - dy / 2;
+
+        while (y1 != y2) {
             if (error > 0 || (error == 0 && iy > 0)) {
                 error = error - dy;
                 x1 = x1 + ix;
@@ -339,527 +1397,3338 @@ void bresenham(Game* game, int x1, int y1, int x2, int y2, bool (*plot) (Game* g
             error = error + dx;
             y1 = y1 + iy;
 
-            if (!plot(game, x1, y1)) return;
-        }
-    }
+            if (!visit(data, x1, y1)) return;
+        }
+    }
+
+}
+
+typedef struct {
+    Game* game;
+    bool (*plot) (Game* game, int x, int y);
+} BresenhamPlot;
+
+bool bresenhamVisit(void* data, int x, int y) {
+    BresenhamPlot* p = data;
+    return p->plot(p->game, x, y);
+}
+
+void bresenham(Game* game, int x1, int y1, int x2, int y2, bool (*plot) (Game* game, int x, int y)) {
+    BresenhamPlot p = {game, plot};
+    traceLine(x1, y1, x2, y2, &bresenhamVisit, &p);
+}
+
+typedef struct {
+    FovTable* table;
+    int ray;
+} FovTableRay;
+
+bool fovTableRayVisit(void* data, int x, int y) {
+
+    FovTableRay* r = data;
+    FovTable* table = r->table;
+
+    int side = 2 * table->halfRadius;
+    int cell = table->cellIndices[(y + table->halfRadius) * side + (x + table->halfRadius)];
+
+    table->cellRays[cell * table->wordsCount + r->ray / 64] |= (uint64_t) 1 << (r->ray % 64);
+
+    return true;
+
+}
+
+// cells of the vision box sorted by chebyshev distance, which equals the step index
+// at which any bresenham ray from the origin reaches them
+int compareFovCells(const void* a, const void* b) {
+    const Coord* ca = a;
+    const Coord* cb = b;
+    int da = abs(ca->x) > abs(ca->y) ? abs(ca->x) : abs(ca->y);
+    int db = abs(cb->x) > abs(cb->y) ? abs(cb->x) : abs(cb->y);
+    if (da != db) return da - db;
+    if (ca->y != cb->y) return ca->y - cb->y;
+    return ca->x - cb->x;
+}
+
+void buildFovTable(FovTable* table, int visionRadius) {
+
+    int hr = (int) floor((float) visionRadius / 2);
+    int side = 2 * hr;
+
+    table->visionRadius = visionRadius;
+    table->halfRadius = hr;
+    table->raysCount = side * side;
+    table->wordsCount = (table->raysCount + 63) / 64;
+    table->cellsCount = side * side;
+
+    table->cellOffsets = malloc(table->cellsCount * sizeof(Coord));
+    table->cellIndices = malloc(table->cellsCount * sizeof(int));
+    table->cellRays = calloc((size_t) table->cellsCount * table->wordsCount, sizeof(uint64_t));
+
+    // same box as the per-target bresenham version: offsets -hr .. hr - 1 on both axes
+    for (int i = 0; i < table->cellsCount; ++i) table->cellOffsets[i] = (Coord) {i % side - hr, i / side - hr};
+    qsort(table->cellOffsets, table->cellsCount, sizeof(Coord), &compareFovCells);
+
+    for (int i = 0; i < table->cellsCount; ++i) {
+        Coord c = table->cellOffsets[i];
+        table->cellIndices[(c.y + hr) * side + (c.x + hr)] = i;
+    }
+
+    // one ray per box cell, marked on every cell the ray passes through
+    for (int ray = 0; ray < table->raysCount; ++ray) {
+        FovTableRay r = {table, ray};
+        traceLine(0, 0, ray % side - hr, ray / side - hr, &fovTableRayVisit, &r);
+    }
+
+}
+
+// tables are shared by every viewer with the same vision radius
+FovTable* getFovTable(Game* game, int visionRadius) {
+
+    for (size_t i = 0; i < game->fovTablesCount; ++i)
+        if (game->fovTables[i].visionRadius == visionRadius) return &game->fovTables[i];
+
+    if (game->fovTablesCount >= FOV_TABLES_MAX_COUNT) {
+        printf("ERROR: fov tables cache is full, can't add radius %d\n", visionRadius);
+        exit(1);
+    }
+
+    FovTable* table = &game->fovTables[game->fovTablesCount++];
+    buildFovTable(table, visionRadius);
+
+    return table;
+
+}
+
+// walks box cells outwards, plotting each one still reached by an unblocked ray;
+// a cell that fails to plot blocks every ray passing through it
+void fovTableCompute(Game* game, FovTable* table, int x, int y, bool (*plot) (Game* game, int x, int y)) {
+
+    int words = table->wordsCount;
+    if (words == 0) return;
+
+    uint64_t blocked[words];
+    memset(blocked, 0, sizeof(blocked));
+
+    for (int i = 0; i < table->cellsCount; ++i) {
+
+        uint64_t* rays = &table->cellRays[(size_t) i * words];
+
+        bool reached = false;
+        for (int w = 0; w < words; ++w) reached |= (rays[w] & ~blocked[w]) != 0;
+        if (!reached) continue;
+
+        Coord offset = table->cellOffsets[i];
+        if (!plot(game, x + offset.x, y + offset.y))
+            for (int w = 0; w < words; ++w) blocked[w] |= rays[w];
+
+    }
+
+}
+
+void calcLOS(Game* game, const int x, const int y, const int boxRadius) {
+
+    clearLOS(game);
+
+    fovTableCompute(game, getFovTable(game, boxRadius), x, y, &plot);
+
+}
+
+void freeMap(Map* map) {
+
+    clearExploredMap(map);
+    free(map->explored.chunks);
+    free(map->tiles);
+    free(map->overrides.keys);
+    free(map->overrides.fgColors);
+    free(map->dirty.bits);
+    free(map->dirty.tiles);
+    free(map->walkable);
+    free(map->los.tiles);
+
+    *map = (Map) {0};
+
+}
+
+// keeps the existing buffers when the size didn't change, tile contents are left undefined
+void allocateMap(Map* map, int width, int height) {
+
+    if (map->width != width || map->height != height) {
+
+        if (map->width != 0) freeMap(map);
+
+        map->width = width;
+        map->height = height;
+
+        size_t tilesCount = (size_t) width * height;
+
+        map->tiles = malloc(tilesCount * sizeof(Tile));
+
+        map->explored.chunksWidth = (width + EXPLORED_CHUNK_SIZE - 1) / EXPLORED_CHUNK_SIZE;
+        map->explored.chunksHeight = (height + EXPLORED_CHUNK_SIZE - 1) / EXPLORED_CHUNK_SIZE;
+        map->explored.chunks = calloc((size_t) map->explored.chunksWidth * map->explored.chunksHeight, sizeof(ExploredChunk*));
+
+        map->dirty.capacity = tilesCount < MAP_DIRTY_TILES_MAX_COUNT ? tilesCount : MAP_DIRTY_TILES_MAX_COUNT;
+        map->dirty.bits = calloc((tilesCount + 63) / 64, sizeof(uint64_t));
+        map->dirty.tiles = malloc(map->dirty.capacity * sizeof(int));
+
+    }
+
+    clearTileOverrides(&map->overrides);
+    clearExploredMap(map);
+
+    map->los.count = 0;
+    map->roomsCount = 0;
+    map->stairsUp = (Coord) {-1, -1};
+    map->stairsDown = (Coord) {-1, -1};
+
+    clearDirtyTiles(map);
+    markMapDirty(map);
+
+}
+
+// labels passable tiles by connected region (4-neighbourhood) using a scanline flood fill,
+// blocked tiles get -1; returns the regions count and writes the id of the largest one
+int labelMapRegions(Map* map, int* labels, int* largestRegion) {
+
+    int width = map->width;
+    int height = map->height;
+
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            labels[y * width + x] = isTileBlocksMovement(mapGetTile(map, x, y)) ? -1 : -2;
+
+    size_t stackCapacity = 1024;
+    size_t stackCount = 0;
+    Coord* stack = malloc(stackCapacity * sizeof(Coord));
+
+    int regionsCount = 0;
+    int largestSize = 0;
+    *largestRegion = -1;
+
+    for (int i = 0; i < width * height; ++i) {
+
+        if (labels[i] != -2) continue;
+
+        int region = regionsCount++;
+        int size = 0;
+
+        stack[stackCount++] = (Coord) {i % width, i / width};
+
+        while (stackCount > 0) {
+
+            Coord seed = stack[--stackCount];
+            int* row = &labels[seed.y * width];
+
+            if (row[seed.x] != -2) continue;
+
+            int left = seed.x;
+            while (left > 0 && row[left - 1] == -2) left--;
+
+            bool spanAbove = false;
+            bool spanBelow = false;
+
+            for (int x = left; x < width && row[x] == -2; ++x) {
+
+                row[x] = region;
+                size++;
+
+                // push one seed per unlabeled span on the neighbouring rows
+                for (int dy = -1; dy <= 1; dy += 2) {
+
+                    int ny = seed.y + dy;
+                    bool* inSpan = dy < 0 ? &spanAbove : &spanBelow;
+
+                    if (ny < 0 || ny >= height) continue;
+
+                    bool open = labels[ny * width + x] == -2;
+
+                    if (open && !*inSpan) {
+                        if (stackCount == stackCapacity) {
+                            stackCapacity *= 2;
+                            stack = realloc(stack, stackCapacity * sizeof(Coord));
+                        }
+                        stack[stackCount++] = (Coord) {x, ny};
+                    }
+
+                    *inSpan = open;
+
+                }
+
+            }
+
+        }
+
+        if (size > largestSize) {
+            largestSize = size;
+            *largestRegion = region;
+        }
+
+    }
+
+    free(stack);
+
+    return regionsCount;
+
+}
+
+void buildWalkableIndex(Map* map) {
+
+    size_t tilesCount = (size_t) map->width * map->height;
+
+    // counted first, so the index is sized to the floor and not the whole map
+    size_t walkableCount = 0;
+    for (size_t i = 0; i < tilesCount; ++i) walkableCount += !isTileBlocksMovement(&map->tiles[i]);
+
+    free(map->walkable);
+    map->walkable = malloc((walkableCount > 0 ? walkableCount : 1) * sizeof(int));
+    map->walkableCount = 0;
+
+    for (size_t i = 0; i < tilesCount; ++i)
+        if (!isTileBlocksMovement(&map->tiles[i])) map->walkable[map->walkableCount++] = (int) i;
+
+}
+
+// walls off every region not connected to the largest one and indexes the remaining floor,
+// returns the regions count found before the repair
+int repairMapConnectivity(Map* map) {
+
+    int* labels = malloc((size_t) map->width * map->height * sizeof(int));
+
+    int largestRegion;
+    int regionsCount = labelMapRegions(map, labels, &largestRegion);
+
+    for (int i = 0; i < map->width * map->height; ++i)
+        if (labels[i] >= 0 && labels[i] != largestRegion)
+            *mapGetTile(map, i % map->width, i / map->width) = createTile(TileTypeWall);
+
+    free(labels);
+
+    buildWalkableIndex(map);
+
+    return regionsCount;
+
+}
+
+Coord randomWalkableTile(Map* map, Rng* rng) {
+    int i = map->walkable[rngRange(rng, 0, map->walkableCount - 1)];
+    return (Coord) {i % map->width, i / map->width};
+}
+
+void placePlayer(Game* game, Coord coord) {
+
+    game->autoExplore.active = false;
+    game->player.coord = coord;
+    game->player.glyph.position = coord2vector(game, game->player.coord);
+
+    cameraPosition(game, game->player.glyph.position);
+    cameraTarget(game, game->player.glyph.position);
+
+    calcLOS(game, game->player.coord.x, game->player.coord.y, game->player.visionRadius);
+
+}
+
+// random walk carving corridors, with rooms dropped along the way
+size_t generateWormMap(Map* map, Rng* rng, const MapGeneratorParams* params) {
+
+    int currentX = rngRange(rng, params->bordersPadding, map->width - params->bordersPadding);
+    int currentY = rngRange(rng, params->bordersPadding, map->height - params->bordersPadding);
+
+    bool updateDirection = true;
+
+    int directionX = 0;
+    int directionY = 0;
+
+    int steps = 0;
+    int roomCooldown = 0;
+
+    size_t roomsCount = 0;
+
+    long stepsCount = (long) map->width * map->height * params->stepsPercent / 100;
+    long attempts = 0;
+
+    while(1) {
+
+        if (steps >= stepsCount || attempts++ >= stepsCount * MAP_GENERATOR_WORM_ATTEMPTS_PER_STEP) break;
+
+        if (updateDirection) {
+
+            updateDirection = false;
+            int randomDirection = rngRange(rng, 0, 1) == 0 ? -1 : 1;
+
+            if (directionX != 0) {
+                directionX = 0;
+                directionY = randomDirection;
+            } else if (directionY != 0) {
+                directionX = randomDirection;
+                directionY = 0;
+            } else {
+                if (rngRange(rng, 0, 1) == 0) directionX = randomDirection;
+                else directionY = randomDirection;
+            }
+        }
+
+        int nextX = currentX + directionX;
+        int nextY = currentY + directionY;
+
+        if (nextX >= map->width - params->bordersPadding || nextX < params->bordersPadding
+            || nextY >= map->height - params->bordersPadding || nextY < params->bordersPadding) {
+            updateDirection = true;
+            continue;
+        }
+
+        if (rngRange(rng, 0, 100) <= params->directionChangeChance) {
+            updateDirection = true;
+            // continue;
+        }
+
+        currentX = nextX;
+        currentY = nextY;
+
+        Tile* currentTile = mapGetTile(map, currentX, currentY);
+
+        bool isInRoom = (directionY != 0 && currentX + 1 < map->width && mapGetTile(map, currentX + 1, currentY)->type != TileTypeWall)
+                        || (directionY != 0 && currentX - 1 >= 0 && mapGetTile(map, currentX - 1, currentY)->type != TileTypeWall)
+                        || (directionX != 0 && currentY + 1 < map->height && mapGetTile(map, currentX, currentY + 1)->type != TileTypeWall)
+                        || (directionX != 0 && currentY - 1 >= 0 && mapGetTile(map, currentX, currentY - 1)->type != TileTypeWall);
+
+        if (!isInRoom && roomCooldown == 0 && rngRange(rng, 0, 100) <= params->roomChance) {
+
+           int roomWidth = rngRange(rng, params->roomMinWidth, params->roomMaxWidth);
+           int roomHeight = rngRange(rng, params->roomMinHeight, params->roomMaxHeight);
+           int roomHalfWidth = floor((float) roomWidth / 2.0f);
+           int roomHalfHeight = floor((float) roomHeight / 2.0f);
+
+           int roomStartX = currentX - roomHalfWidth;
+           if (roomStartX < 0) roomStartX = 0;
+
+           int roomStartY = currentY - roomHalfHeight;
+           if (roomStartY < 0) roomStartY = 0;
+
+           int roomEndX = roomStartX + roomWidth;
+           if (roomEndX >= map->width) roomEndX = map->width - 1;
+
+           int roomEndY = roomStartY + roomHeight;
+           if (roomEndY >= map->height) roomEndY = map->height - 1;
+
+           for (int roomY = roomStartY; roomY <= roomEndY; ++roomY) {
+               for (int roomX = roomStartX; roomX <= roomEndX; ++roomX) {
+
+                   *mapGetTile(map, roomX, roomY) = createTile(TileTypeFloor);
+
+               }
+           }
+
+           ++roomsCount;
+
+           roomCooldown = params->roomCooldown;
+
+        }
+
+        if (currentTile->type == TileTypeWall) {
+            *currentTile = createTile(TileTypeFloor);
+            setTileOverride(map, currentX, currentY, YELLOW);
+        }
+
+        steps++;
+        if (roomCooldown > 0) roomCooldown--;
+
+    }
+
+    return roomsCount;
+
+}
+
+void carveCorridorTile(Map* map, int x, int y) {
+    Tile* t = mapGetTile(map, x, y);
+    if (t->type != TileTypeWall) return;
+    *t = createTile(TileTypeFloor);
+    setTileOverride(map, x, y, YELLOW);
+}
+
+// splits the area along its longer side until leaves get too small, puts a room in every leaf
+// and joins sibling subtrees with an L-shaped corridor; returns a floor tile of the subtree
+Coord splitBspArea(Map* map, Rng* rng, const MapGeneratorParams* params, int x, int y, int width, int height, size_t* roomsCount) {
+
+    bool canSplitX = width >= 2 * params->bspMinLeafSize;
+    bool canSplitY = height >= 2 * params->bspMinLeafSize;
+
+    if (!canSplitX && !canSplitY) {
+
+        int maxWidth = width - 2 * params->bspRoomPadding < params->roomMaxWidth ? width - 2 * params->bspRoomPadding : params->roomMaxWidth;
+        int maxHeight = height - 2 * params->bspRoomPadding < params->roomMaxHeight ? height - 2 * params->bspRoomPadding : params->roomMaxHeight;
+
+        int roomWidth = rngRange(rng, params->roomMinWidth, maxWidth);
+        int roomHeight = rngRange(rng, params->roomMinHeight, maxHeight);
+        int roomX = rngRange(rng, x + params->bspRoomPadding, x + width - params->bspRoomPadding - roomWidth);
+        int roomY = rngRange(rng, y + params->bspRoomPadding, y + height - params->bspRoomPadding - roomHeight);
+
+        for (int ry = roomY; ry < roomY + roomHeight; ++ry)
+            for (int rx = roomX; rx < roomX + roomWidth; ++rx)
+                *mapGetTile(map, rx, ry) = createTile(TileTypeFloor);
+
+        ++*roomsCount;
+
+        return (Coord) {roomX + roomWidth / 2, roomY + roomHeight / 2};
+
+    }
+
+    bool splitX = canSplitX && (!canSplitY || width > height || (width == height && rngRange(rng, 0, 1) == 0));
+
+    Coord a, b;
+
+    if (splitX) {
+        int split = rngRange(rng, params->bspMinLeafSize, width - params->bspMinLeafSize);
+        a = splitBspArea(map, rng, params, x, y, split, height, roomsCount);
+        b = splitBspArea(map, rng, params, x + split, y, width - split, height, roomsCount);
+    } else {
+        int split = rngRange(rng, params->bspMinLeafSize, height - params->bspMinLeafSize);
+        a = splitBspArea(map, rng, params, x, y, width, split, roomsCount);
+        b = splitBspArea(map, rng, params, x, y + split, width, height - split, roomsCount);
+    }
+
+    int stepX = b.x > a.x ? 1 : -1;
+    int stepY = b.y > a.y ? 1 : -1;
+
+    for (int cx = a.x; cx != b.x; cx += stepX) carveCorridorTile(map, cx, a.y);
+    for (int cy = a.y; cy != b.y; cy += stepY) carveCorridorTile(map, b.x, cy);
+
+    return rngRange(rng, 0, 1) == 0 ? a : b;
+
+}
+
+size_t generateBspMap(Map* map, Rng* rng, const MapGeneratorParams* params) {
+
+    size_t roomsCount = 0;
+
+    // inside the border walls
+    splitBspArea(map, rng, params, 1, 1, map->width - 2, map->height - 2, &roomsCount);
+
+    return roomsCount;
+
+}
+
+// adds a bit plane to a bit-sliced counter, count[i] holds bit i of 64 tile counts at once
+void addBitPlane(uint64_t count[4], uint64_t plane) {
+    for (int i = 0; i < 4 && plane != 0; ++i) {
+        uint64_t carry = count[i] & plane;
+        count[i] ^= plane;
+        plane = carry;
+    }
+}
+
+// one automaton step on packed wall bits (bit i of word w is column w * 64 + i): a tile becomes
+// a wall with 5 or more wall neighbours, floor with 3 or less, and stays as it is with 4;
+// everything outside the map counts as wall
+void stepCaveAutomaton(const uint64_t* walls, uint64_t* next, int wordsPerRow, int height, uint64_t lastWordMask) {
+
+    for (int y = 0; y < height; ++y) {
+
+        const uint64_t* rows[3] = {
+            y > 0 ? &walls[(size_t) (y - 1) * wordsPerRow] : NULL,
+            &walls[(size_t) y * wordsPerRow],
+            y + 1 < height ? &walls[(size_t) (y + 1) * wordsPerRow] : NULL,
+        };
+
+        for (int w = 0; w < wordsPerRow; ++w) {
+
+            uint64_t count[4] = {0};
+
+            for (int r = 0; r < 3; ++r) {
+
+                const uint64_t* row = rows[r];
+
+                uint64_t center = row ? row[w] : ~0ull;
+                uint64_t left = row && w > 0 ? row[w - 1] : ~0ull;
+                uint64_t right = row && w + 1 < wordsPerRow ? row[w + 1] : ~0ull;
+
+                addBitPlane(count, (center << 1) | (left >> 63));
+                addBitPlane(count, (center >> 1) | (right << 63));
+                if (r != 1) addBitPlane(count, center);
+
+            }
+
+            uint64_t atLeast5 = count[3] | (count[2] & (count[1] | count[0]));
+            uint64_t exactly4 = count[2] & ~count[1] & ~count[0];
+
+            uint64_t* out = &next[(size_t) y * wordsPerRow + w];
+            *out = atLeast5 | (exactly4 & rows[1][w]);
+            if (w == wordsPerRow - 1) *out |= ~lastWordMask;
+
+        }
+
+    }
+
+}
+
+// random noise smoothed into caves by a cellular automaton running 64 tiles per word operation
+size_t generateCaveMap(Map* map, Rng* rng, const MapGeneratorParams* params) {
+
+    int wordsPerRow = (map->width + 63) / 64;
+    size_t wordsCount = (size_t) wordsPerRow * map->height;
+    uint64_t lastWordMask = map->width % 64 == 0 ? ~0ull : ((uint64_t) 1 << (map->width % 64)) - 1;
+
+    uint64_t* walls = calloc(wordsCount, sizeof(uint64_t));
+    uint64_t* next = malloc(wordsCount * sizeof(uint64_t));
+
+    for (int y = 0; y < map->height; ++y) {
+        uint64_t* row = &walls[(size_t) y * wordsPerRow];
+        for (int x = 0; x < map->width; ++x)
+            if (rngRange(rng, 0, 99) < params->caveInitialWallChance) row[x / 64] |= (uint64_t) 1 << (x % 64);
+        row[wordsPerRow - 1] |= ~lastWordMask;
+    }
+
+    for (int i = 0; i < params->caveIterationsCount; ++i) {
+        stepCaveAutomaton(walls, next, wordsPerRow, map->height, lastWordMask);
+        uint64_t* swap = walls;
+        walls = next;
+        next = swap;
+    }
+
+    for (int y = 0; y < map->height; ++y) {
+        uint64_t* row = &walls[(size_t) y * wordsPerRow];
+        for (int x = 0; x < map->width; ++x)
+            if (!(row[x / 64] >> (x % 64) & 1)) *mapGetTile(map, x, y) = createTile(TileTypeFloor);
+    }
+
+    free(walls);
+    free(next);
+
+    return 0;
+
+}
+
+MapGenerator mapGenerators[] = {
+    {"worm", &generateWormMap},
+    {"bsp", &generateBspMap},
+    {"cave", &generateCaveMap},
+};
+
+// the first level is always the worm walk, deeper levels cycle through every generator
+MapGenerator* getDepthMapGenerator(int depth) {
+    return &mapGenerators[depth % (sizeof(mapGenerators) / sizeof(mapGenerators[0]))];
+}
+
+MapGenerator* findMapGenerator(const char* name) {
+    for (size_t i = 0; i < sizeof(mapGenerators) / sizeof(mapGenerators[0]); ++i)
+        if (strcmp(mapGenerators[i].name, name) == 0) return &mapGenerators[i];
+    return NULL;
+}
+
+// "name=value" from the command line, names are the params fields in snake case
+bool setMapGeneratorParam(MapGeneratorParams* params, const char* assignment) {
+
+    struct { const char* name; int* value; int min; int max; } fields[] = {
+        {"borders_padding", &params->bordersPadding, 1, INT16_MAX},
+        {"steps_percent", &params->stepsPercent, 1, 1000},
+        {"direction_change_chance", &params->directionChangeChance, 0, 100},
+        {"room_chance", &params->roomChance, 0, 100},
+        {"room_cooldown", &params->roomCooldown, 0, INT16_MAX},
+        {"room_min_width", &params->roomMinWidth, 1, INT16_MAX},
+        {"room_max_width", &params->roomMaxWidth, 1, INT16_MAX},
+        {"room_min_height", &params->roomMinHeight, 1, INT16_MAX},
+        {"room_max_height", &params->roomMaxHeight, 1, INT16_MAX},
+        {"bsp_min_leaf_size", &params->bspMinLeafSize, 1, INT16_MAX},
+        {"bsp_room_padding", &params->bspRoomPadding, 0, INT16_MAX},
+        {"cave_initial_wall_chance", &params->caveInitialWallChance, 0, 100},
+        {"cave_iterations_count", &params->caveIterationsCount, 0, 1000},
+    };
+
+    const char* separator = strchr(assignment, '=');
+    if (separator == NULL) return false;
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        if (strlen(fields[i].name) == (size_t) (separator - assignment) && strncmp(fields[i].name, assignment, separator - assignment) == 0) {
+
+            char* end;
+            long value = strtol(separator + 1, &end, 10);
+
+            if (end == separator + 1 || *end != '\0' || value < fields[i].min || value > fields[i].max) {
+                printf("ERROR: %s must be an integer in %d..%d\n", fields[i].name, fields[i].min, fields[i].max);
+                return false;
+            }
+
+            *fields[i].value = value;
+            return true;
+
+        }
+    }
+
+    return false;
+
+}
+
+// ranges between params and the map size that single values can't be checked against
+bool validateMapGeneratorParams(const MapGeneratorParams* params, int width, int height) {
+
+    int roomMinSize = params->roomMinWidth > params->roomMinHeight ? params->roomMinWidth : params->roomMinHeight;
+
+    if (params->roomMinWidth > params->roomMaxWidth || params->roomMinHeight > params->roomMaxHeight) {
+        printf("ERROR: room min size %dx%d is larger than max size %dx%d\n", params->roomMinWidth, params->roomMinHeight,
+               params->roomMaxWidth, params->roomMaxHeight);
+        return false;
+    }
+
+    if (params->bspMinLeafSize < roomMinSize + 2 * params->bspRoomPadding) {
+        printf("ERROR: bsp_min_leaf_size %d can't fit a %d tile room with %d tiles of padding\n", params->bspMinLeafSize,
+               roomMinSize, params->bspRoomPadding);
+        return false;
+    }
+
+    if (width <= 2 * params->bordersPadding + 1 || height <= 2 * params->bordersPadding + 1
+        || width < 2 * params->bspMinLeafSize || height < 2 * params->bspMinLeafSize) {
+        printf("ERROR: map size %dx%d is too small for borders_padding %d and bsp_min_leaf_size %d\n", width, height,
+               params->bordersPadding, params->bspMinLeafSize);
+        return false;
+    }
+
+    return true;
+
+}
+
+void printMapGeneratorParams(const MapGeneratorParams* params, int width, int height) {
+    printf("map size: %dx%d\n", width, height);
+    printf("min room size: %dx%d\n", params->roomMinWidth, params->roomMinHeight);
+    printf("max possible rooms count: %d\n", MAX_ROOMS_COUNT(width, height, params));
+}
+
+// everything but the player: fills with walls, runs the generator, walls the borders, keeps only the
+// largest region and places stairs; returns false when no floor is left
+bool buildMap(Map* map, Rng* rng, MapGenerator* generator, const MapGeneratorParams* params, int width, int height,
+              bool withStairsUp, Coord* spawn, MapStats* stats) {
+
+    allocateMap(map, width, height);
+
+    fillMap(map, TileTypeWall);
+
+    map->roomsCount = generator->generate(map, rng, params);
+
+    fillMapBorder(map, TileTypeWall);
+
+    int regionsCount = repairMapConnectivity(map);
+    if (stats != NULL) stats->regionsCount = regionsCount;
+
+    if (map->walkableCount == 0) return false;
+
+    // spawn at random floor tile, with up stairs under it below the first level
+    // and down stairs on another floor tile
+
+    *spawn = randomWalkableTile(map, rng);
+
+    if (withStairsUp) {
+        *mapGetTile(map, spawn->x, spawn->y) = createTile(TileTypeStairsUp);
+        map->stairsUp = *spawn;
+    }
+
+    Coord stairsDown = *spawn;
+    while (stairsDown.x == spawn->x && stairsDown.y == spawn->y && map->walkableCount > 1)
+        stairsDown = randomWalkableTile(map, rng);
+
+    *mapGetTile(map, stairsDown.x, stairsDown.y) = createTile(TileTypeStairsDown);
+    map->stairsDown = stairsDown;
+
+    return true;
+
+}
+
+void bufferPush(ByteBuffer* buffer, const void* data, size_t size) {
+
+    if (buffer->size + size > buffer->capacity) {
+        while (buffer->size + size > buffer->capacity) buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+
+}
+
+void bufferPushByte(ByteBuffer* buffer, uint8_t byte) {
+    bufferPush(buffer, &byte, 1);
+}
+
+// LEB128, 7 bits per byte
+void bufferPushVarint(ByteBuffer* buffer, uint64_t value) {
+    while (value >= 0x80) {
+        bufferPushByte(buffer, (uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    bufferPushByte(buffer, (uint8_t) value);
+}
+
+uint8_t readerByte(ByteReader* reader) {
+    if (reader->position >= reader->size) {
+        reader->ok = false;
+        return 0;
+    }
+    return reader->data[reader->position++];
+}
+
+uint64_t readerVarint(ByteReader* reader) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && reader->ok; shift += 7) {
+        uint8_t byte = readerByte(reader);
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    reader->ok = false;
+    return 0;
+}
+
+// level layout: header varints, override color palette, runs of (type, palette index + 1 or 0
+// when the tile has no override, length)
+// and alternating runs of unvisited / visited tiles; remembered types are restored as the current ones
+uint8_t* compressLevel(Map* map, size_t* size) {
+
+    ByteBuffer buffer = {0};
+
+    bufferPushVarint(&buffer, map->width);
+    bufferPushVarint(&buffer, map->height);
+    bufferPushVarint(&buffer, map->roomsCount);
+    bufferPushVarint(&buffer, map->stairsUp.x + 1);
+    bufferPushVarint(&buffer, map->stairsUp.y + 1);
+    bufferPushVarint(&buffer, map->stairsDown.x + 1);
+    bufferPushVarint(&buffer, map->stairsDown.y + 1);
+
+    int tilesCount = map->width * map->height;
+
+    // overrides are few distinct colors, collect those into a palette
+    Color palette[255];
+    int paletteCount = 0;
+    bool rawColors = false;
+    uint8_t* colorIndices = calloc(tilesCount, 1);
+
+    for (int i = 0; i < tilesCount && !rawColors; ++i) {
+
+        if (!(map->tiles[i].state & TILE_STATE_OVERRIDE)) continue;
+
+        Color color = getTileFgColor(map, i % map->width, i / map->width);
+
+        int index = 0;
+        while (index < paletteCount && !colorEquals(palette[index], color)) index++;
+
+        if (index == paletteCount) {
+            if (paletteCount == 255) rawColors = true;
+            else palette[paletteCount++] = color;
+        }
+
+        colorIndices[i] = index + 1;
+
+    }
+
+    // past 255 colors the palette is dropped and every overridden run stores its color instead
+    bufferPushByte(&buffer, rawColors);
+
+    if (!rawColors) {
+        bufferPushByte(&buffer, paletteCount);
+        bufferPush(&buffer, palette, paletteCount * sizeof(Color));
+    }
+
+    for (int i = 0; i < tilesCount;) {
+
+        uint8_t type = map->tiles[i].type;
+        bool overridden = map->tiles[i].state & TILE_STATE_OVERRIDE;
+        uint8_t colorIndex = rawColors ? overridden : colorIndices[i];
+        Color color = getTileFgColor(map, i % map->width, i / map->width);
+
+        int run = 1;
+
+        while (i + run < tilesCount && map->tiles[i + run].type == type) {
+            int next = i + run;
+            if (!rawColors && colorIndices[next] != colorIndex) break;
+            if (rawColors && (((map->tiles[next].state & TILE_STATE_OVERRIDE) != 0) != overridden
+                              || (overridden && !colorEquals(getTileFgColor(map, next % map->width, next / map->width), color)))) break;
+            run++;
+        }
+
+        bufferPushByte(&buffer, type);
+        bufferPushByte(&buffer, colorIndex);
+        if (rawColors && overridden) bufferPush(&buffer, &color, sizeof(Color));
+        bufferPushVarint(&buffer, run);
+
+        i += run;
+
+    }
+
+    bool visited = false;
+    for (int i = 0; i < tilesCount;) {
+
+        int run = 0;
+        while (i + run < tilesCount && isTileVisited(map, (i + run) % map->width, (i + run) / map->width) == visited) run++;
+
+        bufferPushVarint(&buffer, run);
+
+        i += run;
+        visited = !visited;
+
+    }
+
+    free(colorIndices);
+
+    *size = buffer.size;
+    return buffer.data;
+
+}
+
+bool decompressLevel(const uint8_t* data, size_t size, Map* map) {
+
+    ByteReader reader = {data, size, 0, true};
+
+    int width = readerVarint(&reader);
+    int height = readerVarint(&reader);
+    if (!reader.ok || width <= 0 || height <= 0) return false;
+
+    allocateMap(map, width, height);
+
+    map->roomsCount = readerVarint(&reader);
+    map->stairsUp.x = (int) readerVarint(&reader) - 1;
+    map->stairsUp.y = (int) readerVarint(&reader) - 1;
+    map->stairsDown.x = (int) readerVarint(&reader) - 1;
+    map->stairsDown.y = (int) readerVarint(&reader) - 1;
+
+    Color palette[255];
+    bool rawColors = readerByte(&reader);
+    int paletteCount = rawColors ? 0 : readerByte(&reader);
+    if (paletteCount > 255) return false;
+
+    for (int i = 0; i < paletteCount; ++i) {
+        palette[i].r = readerByte(&reader);
+        palette[i].g = readerByte(&reader);
+        palette[i].b = readerByte(&reader);
+        palette[i].a = readerByte(&reader);
+    }
+
+    int tilesCount = width * height;
+
+    for (int i = 0; i < tilesCount && reader.ok;) {
+
+        TileType type = readerByte(&reader);
+        int colorIndex = readerByte(&reader);
+
+        Color color = {0};
+        if (rawColors && colorIndex == 1) {
+            color.r = readerByte(&reader);
+            color.g = readerByte(&reader);
+            color.b = readerByte(&reader);
+            color.a = readerByte(&reader);
+        } else if (colorIndex > 0 && colorIndex <= paletteCount) color = palette[colorIndex - 1];
+
+        int run = readerVarint(&reader);
+
+        if (colorIndex > (rawColors ? 1 : paletteCount) || run <= 0 || i + run > tilesCount) reader.ok = false;
+
+        for (int end = i + run; reader.ok && i < end; ++i) {
+            map->tiles[i] = createTile(type);
+            if (colorIndex > 0) setTileOverride(map, i % width, i / width, color);
+        }
+
+    }
+
+    bool visited = false;
+    for (int i = 0; i < tilesCount && reader.ok;) {
+
+        int run = readerVarint(&reader);
+        if (i + run > tilesCount) reader.ok = false;
+
+        for (int end = i + run; reader.ok && i < end; ++i) if (visited) setTileVisited(map, i % width, i / width);
+
+        visited = !visited;
+
+    }
+
+    if (reader.ok) buildWalkableIndex(map);
+
+    return reader.ok;
+
+}
+
+// the process id keeps instances playing the same seed from sharing spill files
+const char* levelSpillPath(Game* game, int depth) {
+    return TextFormat("rogue-level-%d-%016llx-%d.cache", (int) getpid(), (unsigned long long) game->seed, depth);
+}
+
+// spill files of instances that are no longer running, left behind by a crash
+void removeOrphanedLevelSpills() {
+#ifndef _WIN32
+    FilePathList files = LoadDirectoryFilesEx(".", ".cache", false);
+
+    for (unsigned int i = 0; i < files.count; ++i) {
+        int pid;
+        if (sscanf(GetFileName(files.paths[i]), "rogue-level-%d-", &pid) != 1) continue;
+        if (pid != getpid() && kill(pid, 0) != 0 && errno == ESRCH) remove(files.paths[i]);
+    }
+
+    UnloadDirectoryFiles(files);
+#endif
+}
+
+// spills least recently used levels to disk until the in-memory ones fit the budget
+void enforceLevelCacheBudget(Game* game) {
+
+    LevelCache* cache = &game->levelCache;
+
+    while (cache->memoryUsed > cache->memoryBudget) {
+
+        CachedLevel* oldest = NULL;
+        for (size_t i = 0; i < cache->levelsCount; ++i) {
+            CachedLevel* level = &cache->levels[i];
+            if (level->data != NULL && (oldest == NULL || level->lastUsed < oldest->lastUsed)) oldest = level;
+        }
+
+        if (oldest == NULL) return;
+
+        const char* path = levelSpillPath(game, oldest->depth);
+        FILE* file = fopen(path, "wb");
+
+        if (file == NULL || fwrite(oldest->data, oldest->size, 1, file) != 1) {
+            printf("WARNING: can't spill level %d to %s, keeping it in memory\n", oldest->depth, path);
+            if (file != NULL) fclose(file);
+            return;
+        }
+
+        fclose(file);
+
+        cache->memoryUsed -= oldest->size;
+        free(oldest->data);
+        oldest->data = NULL;
+
+    }
+
+}
+
+void levelCachePut(Game* game, int depth, uint8_t* data, size_t size) {
+
+    LevelCache* cache = &game->levelCache;
+
+    if (cache->levelsCount == cache->levelsCapacity) {
+        cache->levelsCapacity = cache->levelsCapacity ? cache->levelsCapacity * 2 : 16;
+        cache->levels = realloc(cache->levels, cache->levelsCapacity * sizeof(CachedLevel));
+    }
+
+    cache->levels[cache->levelsCount++] = (CachedLevel) {depth, ++cache->tick, data, size};
+    cache->memoryUsed += size;
+
+    enforceLevelCacheBudget(game);
+
+}
+
+// whether the level is cached, in memory or spilled to disk
+bool levelCacheHas(Game* game, int depth) {
+    for (size_t i = 0; i < game->levelCache.levelsCount; ++i)
+        if (game->levelCache.levels[i].depth == depth) return true;
+    return false;
+}
+
+// removes the level from the cache, the caller owns the returned data
+uint8_t* levelCacheTake(Game* game, int depth, size_t* size) {
+
+    LevelCache* cache = &game->levelCache;
+
+    for (size_t i = 0; i < cache->levelsCount; ++i) {
+
+        CachedLevel level = cache->levels[i];
+        if (level.depth != depth) continue;
+
+        cache->levels[i] = cache->levels[--cache->levelsCount];
+
+        if (level.data != NULL) {
+            cache->memoryUsed -= level.size;
+            *size = level.size;
+            return level.data;
+        }
+
+        const char* path = levelSpillPath(game, depth);
+        FILE* file = fopen(path, "rb");
+        uint8_t* data = malloc(level.size);
+
+        bool ok = file != NULL && fread(data, level.size, 1, file) == 1;
+        if (file != NULL) fclose(file);
+        remove(path);
+
+        if (!ok) {
+            printf("WARNING: can't read spilled level %d from %s\n", depth, path);
+            free(data);
+            return NULL;
+        }
+
+        *size = level.size;
+        return data;
+
+    }
+
+    return NULL;
+
+}
+
+void clearLevelCache(Game* game) {
+
+    LevelCache* cache = &game->levelCache;
+
+    for (size_t i = 0; i < cache->levelsCount; ++i) {
+        if (cache->levels[i].data != NULL) free(cache->levels[i].data);
+        else remove(levelSpillPath(game, cache->levels[i].depth));
+    }
+
+    cache->levelsCount = 0;
+    cache->memoryUsed = 0;
+
+}
+
+uint64_t levelSeed(uint64_t dungeonSeed, int depth) {
+    Rng rng;
+    rngSeed(&rng, dungeonSeed ^ ((uint64_t) depth * 0xD1B54A32D192ED03ull));
+    return rngNext(&rng);
+}
+
+LightChunk* getLightChunk(Lighting* lighting, int x, int y, bool create) {
+
+    LightChunk** chunk = &lighting->chunks[(y / LIGHT_CHUNK_SIZE) * lighting->chunksWidth + x / LIGHT_CHUNK_SIZE];
+    if (*chunk == NULL && create) *chunk = calloc(1, sizeof(LightChunk));
+
+    return *chunk;
+
+}
+
+uint16_t* getLightBufferTile(Lighting* lighting, int x, int y, bool create) {
+
+    LightChunk* chunk = getLightChunk(lighting, x, y, create);
+    if (chunk == NULL) return NULL;
+
+    return chunk->rgb[(y % LIGHT_CHUNK_SIZE) * LIGHT_CHUNK_SIZE + x % LIGHT_CHUNK_SIZE];
+
+}
+
+bool lightPlot(Game* game, int x, int y) {
+
+    if (!checkMapBounds(&game->map, x, y)) return false;
+
+    Light* light = game->lighting.current;
+
+    float dx = x - light->coord.x;
+    float dy = y - light->coord.y;
+    float intensity = 1.0f - sqrtf(dx * dx + dy * dy) / (light->radius / 2 + 1);
+
+    if (intensity > 0) {
+
+        if (light->cellsCount == light->cellsCapacity) {
+            light->cellsCapacity = light->cellsCapacity ? light->cellsCapacity * 2 : 64;
+            light->cells = realloc(light->cells, light->cellsCapacity * sizeof(LightCell));
+        }
+
+        LightCell* cell = &light->cells[light->cellsCount++];
+        cell->index = y * game->map.width + x;
+        cell->rgb[0] = light->color.r * intensity;
+        cell->rgb[1] = light->color.g * intensity;
+        cell->rgb[2] = light->color.b * intensity;
+
+        uint16_t* rgb = getLightBufferTile(&game->lighting, x, y, true);
+        for (int i = 0; i < 3; ++i) rgb[i] += cell->rgb[i];
+
+        markTileDirty(&game->map, x, y);
+
+    }
+
+    return !isTileBlocksLOS(mapGetTile(&game->map, x, y));
+
+}
+
+void unapplyLight(Game* game, Light* light) {
+
+    for (size_t i = 0; i < light->cellsCount; ++i) {
+
+        LightCell* cell = &light->cells[i];
+        int x = cell->index % game->map.width;
+        int y = cell->index / game->map.width;
+
+        uint16_t* rgb = getLightBufferTile(&game->lighting, x, y, false);
+        for (int c = 0; c < 3; ++c) rgb[c] -= cell->rgb[c];
+
+        markTileDirty(&game->map, x, y);
+
+    }
+
+    light->cellsCount = 0;
+
+}
+
+// drops every light and the light buffer, sized for the current map
+void resetLighting(Game* game) {
+
+    Lighting* lighting = &game->lighting;
+
+    for (size_t i = 0; i < lighting->lightsCount; ++i) free(lighting->lights[i].cells);
+    lighting->lightsCount = 0;
+
+    for (int i = 0; i < lighting->chunksWidth * lighting->chunksHeight; ++i) free(lighting->chunks[i]);
+    free(lighting->chunks);
+
+    lighting->chunksWidth = (game->map.width + LIGHT_CHUNK_SIZE - 1) / LIGHT_CHUNK_SIZE;
+    lighting->chunksHeight = (game->map.height + LIGHT_CHUNK_SIZE - 1) / LIGHT_CHUNK_SIZE;
+    lighting->chunks = calloc((size_t) lighting->chunksWidth * lighting->chunksHeight, sizeof(LightChunk*));
+
+}
+
+size_t addLight(Game* game, Coord coord, Color color, int radius) {
+
+    Lighting* lighting = &game->lighting;
+
+    if (lighting->lightsCount == lighting->lightsCapacity) {
+        lighting->lightsCapacity = lighting->lightsCapacity ? lighting->lightsCapacity * 2 : 64;
+        lighting->lights = realloc(lighting->lights, lighting->lightsCapacity * sizeof(Light));
+    }
+
+    lighting->lights[lighting->lightsCount] = (Light) {coord, color, radius, true, NULL, 0, 0};
+
+    return lighting->lightsCount++;
+
+}
+
+void moveLight(Game* game, size_t index, Coord coord) {
+
+    Light* light = &game->lighting.lights[index];
+    if (light->coord.x == coord.x && light->coord.y == coord.y) return;
+
+    light->coord = coord;
+    light->dirty = true;
+
+}
+
+// relights only lights that moved since the last update; tiles never change during play,
+// a new or restored level rebuilds all of its lights in placeLevelLights
+void updateLighting(Game* game) {
+
+    moveLight(game, game->lighting.playerLight, game->player.coord);
+
+    for (size_t i = 0; i < game->lighting.lightsCount; ++i) {
+
+        Light* light = &game->lighting.lights[i];
+        if (!light->dirty) continue;
+
+        unapplyLight(game, light);
+
+        game->lighting.current = light;
+        fovTableCompute(game, getFovTable(game, light->radius), light->coord.x, light->coord.y, &lightPlot);
+        game->lighting.current = NULL;
+
+        light->dirty = false;
+
+    }
+
+}
+
+// player torch and one torch per room on random floor, seeded by the level so a level
+// restored from the cache gets the same torches without storing them
+void placeLevelLights(Game* game) {
+
+    resetLighting(game);
+
+    game->lighting.playerLight = addLight(game, game->player.coord, (Color) {255, 230, 180, 255}, LIGHT_PLAYER_RADIUS);
+
+    Rng rng;
+    rngSeed(&rng, levelSeed(game->seed, game->depth) ^ 0x4C49474854ull); // "LIGHT"
+
+    for (size_t i = 0; i < game->map.roomsCount && game->map.walkableCount > 0; ++i)
+        addLight(game, randomWalkableTile(&game->map, &rng), (Color) {255, 140, 40, 255}, LIGHT_TORCH_RADIUS);
+
+}
+
+// tiles in LOS are shaded by the light buffer on top of the ambient level
+Color applyLighting(Game* game, int x, int y, Color color) {
+
+    if (!game->lighting.enabled) return color;
+
+    uint16_t* rgb = getLightBufferTile(&game->lighting, x, y, false);
+    uint8_t* channels[3] = {&color.r, &color.g, &color.b};
+
+    for (int i = 0; i < 3; ++i) {
+        float light = LIGHT_AMBIENT + (rgb ? rgb[i] / 255.0f : 0.0f);
+        if (light > 1.0f) light = 1.0f;
+        *channels[i] = *channels[i] * light;
+    }
+
+    return color;
+
+}
+
+double wallClockSeconds() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void* levelGenerationWorker(void* data) {
+
+    LevelGeneration* g = data;
+
+    rngSeed(&g->rng, levelSeed(g->seed, g->depth));
+    g->ok = buildMap(&g->map, &g->rng, getDepthMapGenerator(g->depth), &mapGeneratorParams, MAP_WIDTH, MAP_HEIGHT,
+                     g->depth > 0, &g->spawn, NULL);
+
+    atomic_store(&g->done, true);
+
+    return NULL;
+
+}
+
+void startLevelGeneration(Game* game, int depth) {
+
+    LevelGeneration* g = &game->generation;
+
+    g->seed = game->seed;
+    g->depth = depth;
+    g->ready = false;
+    g->running = true;
+    g->startTime = wallClockSeconds();
+    atomic_store(&g->done, false);
+
+    if (pthread_create(&g->thread, NULL, &levelGenerationWorker, g) != 0) {
+        printf("ERROR: can't start level generation thread\n");
+        exit(1);
+    }
+
+}
+
+// joins a finished generation, with wait blocks until it finishes; true once the result is ready
+bool finishLevelGeneration(LevelGeneration* g, bool wait) {
+
+    if (!g->running) return g->ready;
+    if (!wait && !atomic_load(&g->done)) return false;
+
+    pthread_join(g->thread, NULL);
+
+    g->running = false;
+    g->ready = true;
+
+    return true;
+
+}
+
+// arrives on the up stairs when descending and on the down stairs when ascending
+void arriveAtLevel(Game* game, bool descending) {
+    Coord arrival = descending ? game->map.stairsUp : game->map.stairsDown;
+    if (arrival.x >= 0) placePlayer(game, arrival);
+}
+
+// the generated map trades places with the current one, whose buffers the next generation reuses
+void swapInGeneratedLevel(Game* game) {
+
+    LevelGeneration* g = &game->generation;
+
+    if (!g->ok) {
+        printf("ERROR: generated map has no floor\n");
+        exit(1);
+    }
+
+    Map map = game->map;
+    game->map = g->map;
+    g->map = map;
+
+    game->rng = g->rng;
+    g->ready = false;
+    game->levelPending = false;
+
+    markMapDirty(&game->map);
+    placeLevelLights(game);
+
+    Coord arrival = game->levelPendingDescending ? game->map.stairsUp : game->map.stairsDown;
+    placePlayer(game, arrival.x >= 0 ? arrival : g->spawn);
+
+}
+
+// swaps in the pending level once it is generated, then prefetches the next level down;
+// with wait a pending level is finished before returning, a prefetch never blocks
+void updateLevelGeneration(Game* game, bool wait) {
+
+    LevelGeneration* g = &game->generation;
+
+    // a running generation can't be cancelled, it has to finish first
+    if (g->running && !finishLevelGeneration(g, wait && game->levelPending)) return;
+
+    if (game->levelPending) {
+
+        if (!(g->ready && g->seed == game->seed && g->depth == game->depth)) {
+            startLevelGeneration(game, game->depth);
+            if (!wait) return;
+            finishLevelGeneration(g, true);
+        }
+
+        swapInGeneratedLevel(game);
+
+    }
+
+    int next = game->depth + 1;
+    if (!(g->ready && g->seed == game->seed && g->depth == next) && !levelCacheHas(game, next))
+        startLevelGeneration(game, next);
+
+}
+
+void requestLevel(Game* game, bool descending) {
+    game->levelPending = true;
+    game->levelPendingDescending = descending;
+    updateLevelGeneration(game, false);
+}
+
+// the current level goes into the cache compressed, the target one is restored from it
+// or generated if it was never visited
+void changeLevel(Game* game, int depth) {
+
+    bool descending = depth > game->depth;
+
+    size_t size;
+    uint8_t* data = compressLevel(&game->map, &size);
+    levelCachePut(game, game->depth, data, size);
+
+    game->depth = depth;
+
+    data = levelCacheTake(game, depth, &size);
+    bool restored = data != NULL && decompressLevel(data, size, &game->map);
+    free(data);
+
+    if (!restored) {
+        requestLevel(game, descending);
+        return;
+    }
+
+    placeLevelLights(game);
+    arriveAtLevel(game, descending);
+
+}
+
+void useStairs(Game* game, TileType stairs) {
+
+    Tile* tile = mapGetTile(&game->map, game->player.coord.x, game->player.coord.y);
+    if (tile->type != stairs) return;
+
+    changeLevel(game, stairs == TileTypeStairsDown ? game->depth + 1 : game->depth - 1);
+
+}
+
+void newDungeon(Game* game, uint64_t seed) {
+    clearLevelCache(game);
+    game->seed = seed;
+    game->depth = 0;
+    requestLevel(game, true);
+}
+
+void updateActors(Game* game) {
+    (void) game;
+}
+
+void renderGlyph(Game* game, Coord coord, Glyph* glyph) {
+
+    int cellSize = game->cellSize;
+    float zoom = game->camera.zoom;
+    char chBuffer[2] = {glyph->ch}; // because DrawTextEx requires char*
+
+    Vector2 chTargetPosition = coord2vector(game, coord);
+
+    if (game->renderGlyphsCentered) {
+        GlyphInfo glyphInfo = GetGlyphInfo(*gameFontGet(&game->glyphFont), (int) glyph->ch);
+        Vector2 textSize = MeasureTextEx(*gameFontGet(&game->glyphFont), chBuffer, game->glyphFont.size, game->glyphFont.spacing);
+        chTargetPosition = Vector2Add(chTargetPosition, (Vector2) {(float) cellSize / 2 - (float) glyphInfo.offsetX / 2, (float) cellSize / 2 - (float) glyphInfo.offsetY / 2});
+        chTargetPosition = Vector2Subtract(chTargetPosition, Vector2Scale(textSize, 0.5));
+    }
+
+    if (glyph->animateMovement && !Vector2Equals(glyph->position, chTargetPosition)) {
+        glyph->position = Vector2Lerp(glyph->position, chTargetPosition, easeOutBack(glyph->animationTime));
+        glyph->animationTime += game->deltaTime;
+    } else glyph->position = chTargetPosition;
+
+    Vector2 bgTargetPosition = glyph->position;
+
+    Vector2 chRenderingPosition = vector2screen(game, glyph->position);
+    Vector2 bgRenderingPosition = vector2screen(game, bgTargetPosition);
+
+    DrawRectangleV(bgRenderingPosition, (Vector2) {cellSize * zoom, cellSize * zoom}, glyph->bgColor);
+    DrawTextEx(*gameFontGet(&game->glyphFont), chBuffer, chRenderingPosition, game->glyphFont.size * zoom, game->glyphFont.spacing * zoom, glyph->fgColor);
+
+}
+
+void renderMapTile(Game* game, int x, int y) {
+
+    float alpha = 1.0f;
+
+    Tile* t = mapGetTile(&game->map, x, y);
+
+    bool visited = isTileVisited(&game->map, x, y);
+
+    if (game->useLOS && !isTileInLOS(t) && !visited) return;
+    if (!isTileInLOS(t) && visited) alpha = VISITED_TILE_ALPHA;
+
+    Glyph glyph = getSeenTileGlyph(&game->map, x, y);
+    if (isTileInLOS(t)) glyph.fgColor = applyLighting(game, x, y, glyph.fgColor);
+    glyph.fgColor = Fade(glyph.fgColor, alpha);
+    renderGlyph(game, (Coord) {x, y}, &glyph);
+
+}
+
+// tile range covered by the window, one tile of margin for centered glyphs
+void visibleTilesRange(Game* game, Coord* from, Coord* to) {
+
+    Coord first = screen2coord(game, (Vector2) {0, 0});
+    Coord last = screen2coord(game, (Vector2) {game->windowWidth, game->windowHeight});
+
+    from->x = first.x - 1 < 0 ? 0 : first.x - 1;
+    from->y = first.y - 1 < 0 ? 0 : first.y - 1;
+    to->x = last.x + 1 >= game->map.width ? game->map.width - 1 : last.x + 1;
+    to->y = last.y + 1 >= game->map.height ? game->map.height - 1 : last.y + 1;
+
+}
+
+void renderMapRect(void* data, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+            renderMapTile(data, x, y);
+}
+
+// TODO: add Map* as argument to renderMap()
+
+void renderMap(Game* game) {
+
+    Coord from, to;
+    visibleTilesRange(game, &from, &to);
+
+    // with LOS on only visited tiles are drawn, and tiles in LOS are always visited
+    if (game->useLOS) forEachExploredChunk(&game->map, from, to, &renderMapRect, game);
+    else renderMapRect(game, from.x, from.y, to.x, to.y);
+
+}
+
+int compareInts(const void* a, const void* b) {
+    int ia = *(const int*) a;
+    int ib = *(const int*) b;
+    return (ia > ib) - (ia < ib);
+}
+
+// redraws only tiles marked dirty since the last frame, the caller keeps the previous frame.
+// Centered glyphs can overhang into the next cells, so the 4-neighbours of dirty tiles are redrawn too,
+// in row order like a full redraw
+void renderMapDirty(Game* game) {
+
+    Coord from, to;
+    visibleTilesRange(game, &from, &to);
+
+    DirtyTiles* dirty = &game->map.dirty;
+    int width = game->map.width;
+
+    int* tiles = malloc(dirty->count * 5 * sizeof(int));
+    size_t count = 0;
+
+    const int neighbours[5][2] = {{0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+    for (size_t i = 0; i < dirty->count; ++i)
+        for (int n = 0; n < 5; ++n) {
+            int x = dirty->tiles[i] % width + neighbours[n][0];
+            int y = dirty->tiles[i] / width + neighbours[n][1];
+            if (x >= from.x && x <= to.x && y >= from.y && y <= to.y) tiles[count++] = y * width + x;
+        }
+
+    qsort(tiles, count, sizeof(int), &compareInts);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < count; ++i)
+        if (unique == 0 || tiles[unique - 1] != tiles[i]) tiles[unique++] = tiles[i];
+
+    for (size_t i = 0; i < unique; ++i) {
+        Vector2 position = coord2screen(game, (Coord) {tiles[i] % width, tiles[i] / width});
+        DrawRectangleV(position, (Vector2) {screenCellSize(game), screenCellSize(game)}, BLACK);
+    }
+
+    for (size_t i = 0; i < unique; ++i) renderMapTile(game, tiles[i] % width, tiles[i] / width);
+
+    free(tiles);
+
+}
+
+void renderActor(Game* game, Actor* actor) {
+    renderGlyph(game, actor->coord, &actor->glyph);
+}
+
+void highlightTile(Game* game, Coord coord, Color color) {
+    Vector2 hoverPosition = coord2screen(game, coord);
+    // Rectangle rect = {hoverPosition.x, hoverPosition.y, game->cellSize, game->cellSize};
+    // DrawRectangleRoundedLines(rect, 1, 10, 1, color);
+    DrawRectangleLinesEx((Rectangle) {hoverPosition.x, hoverPosition.y, screenCellSize(game), screenCellSize(game)}, 1, color);
+}
+
+void renderCurrentTileInfo(Game* game) {
+
+    if (checkMapBounds(&game->map, game->mouseCoord.x, game->mouseCoord.y)) {
+
+        Tile* t = mapGetTile(&game->map, game->mouseCoord.x, game->mouseCoord.y);
+
+        if (!isTileInLOS(t) && !isTileVisited(&game->map, game->mouseCoord.x, game->mouseCoord.y)) return;
+
+        highlightTile(game, game->mouseCoord, YELLOW);
+
+        const char* currentTileText = TextFormat("Tile [%c] - %s", tileDefs[t->type].ch, tileDefs[t->type].name);
+        Vector2 size = MeasureTextEx(*gameFontGet(&game->uiFont), currentTileText, game->uiFont.size, game->uiFont.spacing);
+        renderTextBg(&game->uiFont, currentTileText, (Vector2) {10, game->windowHeight - 10 - size.y}, YELLOW, Fade(BLACK, 0.85f));
+
+    }
+
+}
+
+bool plotPathToMousePosition(Game* game, int x, int y) {
+    highlightTile(game, (Coord) {x, y}, GREEN);
+    return true;
+}
+
+void renderPathToMousePosition(Game* game) {
+
+    bresenham(game, game->player.coord.x, game->player.coord.y, game->mouseCoord.x, game->mouseCoord.y, &plotPathToMousePosition);
+
+}
+
+void renderDebugInfo(Game* game, DebugInfo* debugInfo) {
+
+    DebugInfo* di = debugInfo;
+
+    if (!di->visible) return;
+
+    float lineY = 0;
+
+    for (size_t i = 0; i < di->linesCount; ++i) {
+
+        DebugInfoLine* line = &di->lines[i];
+
+        Vector2 position = {di->offset.x, di->offset.y + lineY};
+        Vector2 textSize = renderTextBg(&game->debugFont, line->text, position, line->color, di->bgColor);
+
+        lineY += textSize.y;
+
+    }
+
+}
+
+void addDebugInfoLine(Game* game, const char* text, Color color) {
+
+    DebugInfo* di = &game->ui.debugInfo;
+
+    if (di->linesCount >= sizeof(di->lines) / sizeof(di->lines[0])) return;
+
+    DebugInfoLine* line = &di->lines[di->linesCount];
+    snprintf(line->text, sizeof(line->text), "%s", text);
+    line->color = color;
+
+    di->linesCount++;
+
+}
+
+void clearDebugInfo(Game* game) {
+    game->ui.debugInfo.linesCount = 0;
+}
+
+// shown while the level being entered is still generating
+void renderLevelGenerationProgress(Game* game) {
+
+    if (!game->levelPending) return;
+
+    const char spinner[] = "|/-\\";
+    double elapsed = wallClockSeconds() - game->generation.startTime;
+
+    const char* text = TextFormat("Generating level %d %c", game->depth + 1, spinner[(int) (elapsed * 8) % 4]);
+    Vector2 size = MeasureTextEx(*gameFontGet(&game->uiFont), text, game->uiFont.size, game->uiFont.spacing);
+    renderTextBg(&game->uiFont, text, (Vector2) {(game->windowWidth - size.x) / 2, (game->windowHeight - size.y) / 2}, WHITE, Fade(BLACK, 0.85f));
+
+}
+
+void renderUI(Game* game) {
+
+    // renderPathToMousePosition(game);
+    renderCurrentTileInfo(game);
+    renderLevelGenerationProgress(game);
+
+    renderDebugInfo(game, &game->ui.debugInfo);
+
+}
+
+bool moveActor(Game* game, Actor* actor, int dx, int dy) {
+
+    int tx = actor->coord.x + dx;
+    int ty = actor->coord.y + dy;
+
+    if (tx < 0 || tx >= game->map.width || ty < 0 || ty >= game->map.height) return false;
+
+    Tile* tile = mapGetTile(&game->map, tx, ty);
+
+    if (isTileBlocksMovement(tile)) return false;
+
+    markTileDirty(&game->map, actor->coord.x, actor->coord.y);
+    markTileDirty(&game->map, tx, ty);
+
+    actor->coord.x = tx;
+    actor->coord.y = ty;
+    actor->glyph.animationTime = 0;
+
+    return true;
+
+}
+
+void initPlayer(Actor* player) {
+
+    player->glyph.ch = '@';
+    player->glyph.fgColor = WHITE;
+    player->glyph.bgColor = BLACK;
+    player->glyph.animateMovement = true;
+    player->glyph.animationTime = 0;
+    // player->glyph.t = LERPING_FACTOR(0.5f);
+    // player->glyph.defaultT = player->glyph.t;
+    player->visionRadius = 20;
+
+}
+
+bool movePlayer(Game* game, int dx, int dy) {
+
+    if (moveActor(game, &game->player, dx, dy)) {
+        calcLOS(game, game->player.coord.x, game->player.coord.y, game->player.visionRadius);
+        return true;
+    }
+
+    return false;
+
+}
+
+bool isTilePassable(Game* game, int x, int y) {
+    return checkMapBounds(&game->map, x, y) && !isTileBlocksMovement(mapGetTile(&game->map, x, y));
+}
+
+size_t countActorsInLOS(Game* game) {
+    size_t count = 0;
+    for (size_t i = 0; i < game->actors_count; ++i) {
+        Coord c = game->actors[i].coord;
+        if (checkMapBounds(&game->map, c.x, c.y) && isTileInLOS(mapGetTile(&game->map, c.x, c.y))) count++;
+    }
+    return count;
+}
+
+// passability of the two tiles perpendicular to the running direction
+int runSidesPattern(Game* game, int dx, int dy) {
+    int x = game->player.coord.x;
+    int y = game->player.coord.y;
+    return isTilePassable(game, x + dy, y + dx) | isTilePassable(game, x - dy, y - dx) << 1;
+}
+
+bool isExploreFrontier(Game* game, int x, int y) {
+    const int neighbours[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    for (int i = 0; i < 4; ++i) {
+        int nx = x + neighbours[i][0];
+        int ny = y + neighbours[i][1];
+        if (checkMapBounds(&game->map, nx, ny) && !isTileVisited(&game->map, nx, ny)) return true;
+    }
+    return false;
+}
+
+// a passable tile visited by the last step that still borders unexplored space; tiles on the vision box
+// edge are left out, they always border the unexplored area ahead of the run
+bool isFrontierRevealed(Game* game) {
+
+    int hr = (int) floor((float) game->player.visionRadius / 2);
+
+    for (size_t i = 0; i < game->revealed.count; ++i) {
+
+        Coord c = game->revealed.tiles[i];
+        int ox = c.x - game->player.coord.x;
+        int oy = c.y - game->player.coord.y;
+
+        if (ox <= -hr || ox >= hr - 1 || oy <= -hr || oy >= hr - 1) continue;
+        if (isTilePassable(game, c.x, c.y) && isExploreFrontier(game, c.x, c.y)) return true;
+
+    }
+
+    return false;
+
+}
+
+// runs in a straight line until blocked, a junction or room edge changes the side tiles,
+// a new actor comes into view or a step reveals new frontier; every step is a regular move with the
+// table-driven FOV, which only touches the vision box since clearLOS works from the LOS list
+void runPlayer(Game* game, int dx, int dy) {
+
+    size_t actorsInSight = countActorsInLOS(game);
+
+    game->revealed.tracking = true;
+    game->revealed.count = 0;
+
+    if (movePlayer(game, dx, dy)) {
+
+        int sides = runSidesPattern(game, dx, dy);
+
+        while (runSidesPattern(game, dx, dy) == sides && countActorsInLOS(game) <= actorsInSight && !isFrontierRevealed(game)) {
+            game->revealed.count = 0;
+            if (!movePlayer(game, dx, dy)) break;
+        }
+
+    }
+
+    game->revealed.tracking = false;
+
+}
+
+// breadth-first search over visited tiles to the nearest tile bordering unexplored space,
+// writes the steps from the player into path and returns their count (-1 if nothing is left)
+int findExplorePath(Game* game, int* parents, int* queue, Coord* path) {
+
+    int width = game->map.width;
+    int height = game->map.height;
+    int start = game->player.coord.y * width + game->player.coord.x;
+
+    for (int i = 0; i < width * height; ++i) parents[i] = -1;
+
+    size_t head = 0, tail = 0;
+
+    parents[start] = start;
+    queue[tail++] = start;
+
+    const int neighbours[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+    while (head < tail) {
+
+        int current = queue[head++];
+        int x = current % width;
+        int y = current / width;
+
+        if (current != start && isExploreFrontier(game, x, y)) {
+
+            int length = 0;
+            for (int i = current; i != start; i = parents[i]) length++;
+
+            int step = length;
+            for (int i = current; i != start; i = parents[i]) path[--step] = (Coord) {i % width, i / width};
+
+            return length;
+
+        }
+
+        for (int i = 0; i < 4; ++i) {
+
+            int nx = x + neighbours[i][0];
+            int ny = y + neighbours[i][1];
+            int next = ny * width + nx;
+
+            if (!isTilePassable(game, nx, ny) || parents[next] != -1) continue;
+            if (!isTileVisited(&game->map, nx, ny)) continue;
+
+            parents[next] = current;
+            queue[tail++] = next;
+
+        }
+
+    }
+
+    return -1;
+
+}
+
+// plans the path to the nearest frontier into game->autoExplore, returns false when the level is explored
+bool planExploreLeg(Game* game) {
+
+    AutoExplore* e = &game->autoExplore;
+    size_t tilesCount = (size_t) game->map.width * game->map.height;
+
+    int* parents = malloc(tilesCount * sizeof(int));
+    int* queue = malloc(tilesCount * sizeof(int));
+    e->path = realloc(e->path, tilesCount * sizeof(Coord));
+
+    e->pathLength = findExplorePath(game, parents, queue, e->path);
+    e->pathStep = 0;
+
+    free(parents);
+    free(queue);
+
+    return e->pathLength > 0;
+
+}
+
+// walks towards the nearest unexplored frontier, at most AUTO_EXPLORE_STEPS_PER_COMMAND steps per command;
+// the path stays in game->autoExplore, so the next command continues it after the actors had their turn.
+// Stops for good once the level is explored or a new actor comes into view
+void autoExplorePlayer(Game* game) {
+
+    AutoExplore* e = &game->autoExplore;
+
+    if (!e->active) {
+        e->active = true;
+        e->actorsInSight = countActorsInLOS(game);
+        e->pathLength = 0;
+    }
+
+    for (int steps = 0; steps < AUTO_EXPLORE_STEPS_PER_COMMAND && e->active; ++steps) {
+
+        if (e->pathStep >= e->pathLength && !planExploreLeg(game)) {
+            e->active = false;
+            break;
+        }
+
+        Coord target = e->path[e->pathLength - 1];
+        Coord next = e->path[e->pathStep++];
+
+        if (!movePlayer(game, next.x - game->player.coord.x, next.y - game->player.coord.y)) {
+            e->pathLength = 0;
+            break;
+        }
+
+        if (countActorsInLOS(game) > e->actorsInSight) {
+            e->active = false;
+            break;
+        }
+
+        // leg end, or the target got revealed on the way: replan from here
+        if (e->pathStep >= e->pathLength || !isExploreFrontier(game, target.x, target.y)) e->pathLength = 0;
+
+    }
+
+}
+
+double benchmarkSeconds(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+const int COMMAND_DIRECTIONS[4][2] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+
+// any command other than auto-explore cancels one in progress
+void executeCommand(Game* game, Command command) {
+
+    if (command != CommandAutoExplore) game->autoExplore.active = false;
+
+    switch (command) {
+    case CommandMoveUp:
+    case CommandMoveDown:
+    case CommandMoveLeft:
+    case CommandMoveRight: {
+        const int* d = COMMAND_DIRECTIONS[command - CommandMoveUp];
+        movePlayer(game, d[0], d[1]);
+        break;
+    }
+    case CommandRunUp:
+    case CommandRunDown:
+    case CommandRunLeft:
+    case CommandRunRight: {
+        const int* d = COMMAND_DIRECTIONS[command - CommandRunUp];
+        runPlayer(game, d[0], d[1]);
+        break;
+    }
+    case CommandAutoExplore:
+        autoExplorePlayer(game);
+        break;
+    case CommandRegenerateMap:
+        newDungeon(game, rngNext(&game->rng));
+        break;
+    case CommandDescend:
+        useStairs(game, TileTypeStairsDown);
+        break;
+    case CommandAscend:
+        useStairs(game, TileTypeStairsUp);
+        break;
+    default:
+        break;
+    }
+
+}
+
+// returns at most one command per frame, *repeated is set for held movement keys
+Command pollInputCommand(bool* repeated) {
+
+    const int movementKeys[4] = {KEY_W, KEY_S, KEY_A, KEY_D};
+
+    *repeated = false;
+
+    if (IsKeyPressed(KEY_R)) return CommandRegenerateMap;
+    if (IsKeyPressed(KEY_X)) return CommandAutoExplore;
+    if (IsKeyPressed(KEY_PERIOD)) return CommandDescend;
+    if (IsKeyPressed(KEY_COMMA)) return CommandAscend;
+
+    for (int i = 0; i < 4; ++i) {
+
+        int key = movementKeys[i];
+
+        if (IsKeyPressed(key) && IsKeyDown(KEY_LEFT_SHIFT)) return CommandRunUp + i;
+        if (IsKeyPressed(key)) return CommandMoveUp + i;
+
+        if (IsKeyPressedRepeat(key)) {
+            *repeated = true;
+            return CommandMoveUp + i;
+        }
+
+    }
+
+    return CommandNone;
+
+}
+
+// covers everything the simulation produces: player position, tiles and their LOS/visited state
+uint32_t hashGameState(Game* game) {
+
+    uint32_t hash = 2166136261u;
+    hash = fnv1a(hash, &game->player.coord, sizeof(Coord));
+    hash = fnv1a(hash, &game->map.width, sizeof(int));
+    hash = fnv1a(hash, &game->map.height, sizeof(int));
+    hash = fnv1a(hash, &game->depth, sizeof(int));
+
+    for (int y = 0; y < game->map.height; ++y) {
+        for (int x = 0; x < game->map.width; ++x) {
+            Tile* t = mapGetTile(&game->map, x, y);
+            unsigned char state[3] = {t->type, isTileInLOS(t), isTileVisited(&game->map, x, y)};
+            hash = fnv1a(hash, state, sizeof(state));
+        }
+    }
+
+    return hash;
+
+}
+
+void writeRecordingCheckpoint(Game* game) {
+    uint8_t marker = INPUT_RECORDING_CHECKPOINT;
+    uint32_t hash = hashGameState(game);
+    fwrite(&marker, 1, 1, game->recording.file);
+    fwrite(&hash, sizeof(hash), 1, game->recording.file);
+}
+
+// recording layout: magic, version, seed, then one byte per command
+// with a checkpoint marker and state hash every INPUT_RECORDING_CHECKPOINT_INTERVAL commands
+bool startRecording(Game* game, const char* path) {
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL) {
+        printf("ERROR: can't open %s for recording\n", path);
+        return false;
+    }
+
+    uint32_t header[2] = {INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION};
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(&game->seed, sizeof(game->seed), 1, file);
+
+    game->recording.file = file;
+    game->recording.seed = game->seed;
+    game->recording.commandsCount = 0;
+
+    return true;
+
+}
+
+// a checkpoint is written only once no level is pending: replay waits for the level after every
+// command, so both sides hash the level the player arrived on however long generation took
+void updateRecording(Game* game) {
+
+    if (game->recording.file == NULL || !game->recording.checkpointPending || game->levelPending) return;
+
+    game->recording.checkpointPending = false;
+    writeRecordingCheckpoint(game);
+    fflush(game->recording.file);
+
+}
+
+// called after the command was executed, so checkpoints hash the resulting state
+void recordCommand(Game* game, Command command) {
+
+    if (game->recording.file == NULL) return;
+
+    uint8_t byte = command;
+    fwrite(&byte, 1, 1, game->recording.file);
+
+    if (++game->recording.commandsCount % INPUT_RECORDING_CHECKPOINT_INTERVAL == 0)
+        game->recording.checkpointPending = true;
+
+    updateRecording(game);
+
+    // flushed every turn so a crash still leaves a usable reproduction
+    fflush(game->recording.file);
+
+}
+
+void stopRecording(Game* game) {
+
+    if (game->recording.file == NULL) return;
+
+    updateLevelGeneration(game, true);
+    updateRecording(game);
+    writeRecordingCheckpoint(game);
+    fclose(game->recording.file);
+    game->recording.file = NULL;
+
+}
+
+void initSimulation(Game* game, uint64_t seed) {
+
+    if (!game->levelCache.memoryBudgetSet) {
+        game->levelCache.memoryBudget = LEVEL_CACHE_MEMORY_BUDGET;
+        game->levelCache.memoryBudgetSet = true;
+    }
+    if (game->camera.zoom == 0) game->camera.zoom = 1;
+
+    initPlayer(&game->player);
+    getFovTable(game, game->player.visionRadius);
+    newDungeon(game, seed);
+    updateLevelGeneration(game, true); // the first level is needed before the first frame
+
+}
+
+void shutdownSimulation(Game* game) {
+    finishLevelGeneration(&game->generation, true);
+    freeMap(&game->generation.map);
+    resetLighting(game);
+    free(game->lighting.lights);
+    free(game->lighting.chunks);
+    clearLevelCache(game);
+    free(game->levelCache.levels);
+    freeMap(&game->map);
+    for (size_t i = 0; i < game->fovTablesCount; ++i) {
+        free(game->fovTables[i].cellOffsets);
+        free(game->fovTables[i].cellIndices);
+        free(game->fovTables[i].cellRays);
+    }
+    game->fovTablesCount = 0;
+    free(game->revealed.tiles);
+    free(game->autoExplore.path);
+}
+
+// re-runs a recording without a window as fast as possible, verifying state hashes at checkpoints
+int replayRecording(const char* path, int loops) {
+
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL) {
+        printf("ERROR: can't open recording %s\n", path);
+        return 1;
+    }
+
+    uint32_t header[2] = {0};
+    uint64_t seed = 0;
+
+    if (fread(header, sizeof(header), 1, file) != 1 || fread(&seed, sizeof(seed), 1, file) != 1
+        || header[0] != INPUT_RECORDING_MAGIC || header[1] != INPUT_RECORDING_VERSION) {
+        printf("ERROR: %s is not a recording\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    long recordsStart = ftell(file);
+
+    size_t commandsCount = 0;
+    size_t checkpointsCount = 0;
+    double simulationTime = 0;
+    bool ok = true;
+
+    for (int loop = 0; loop < loops && ok; ++loop) {
+
+        fseek(file, recordsStart, SEEK_SET);
+
+        Game* game = calloc(1, sizeof(Game));
+        game->windowWidth = WINDOW_WIDTH;
+        game->windowHeight = WINDOW_HEIGHT;
+        game->cellSize = 32;
+
+        clock_t start = clock();
+
+        initSimulation(game, seed);
+
+        int record;
+        while ((record = fgetc(file)) != EOF) {
+
+            if (record == INPUT_RECORDING_CHECKPOINT) {
+
+                uint32_t expected = 0;
+                if (fread(&expected, sizeof(expected), 1, file) != 1) break;
+
+                uint32_t actual = hashGameState(game);
+                checkpointsCount++;
+
+                if (actual != expected) {
+                    printf("ERROR: replay diverged after %zu commands: state hash %08x, expected %08x\n",
+                           commandsCount, actual, expected);
+                    ok = false;
+                    break;
+                }
+
+                continue;
+
+            }
+
+            if (record >= CommandsCount) {
+                printf("ERROR: unknown command %d in recording\n", record);
+                ok = false;
+                break;
+            }
+
+            executeCommand(game, (Command) record);
+            updateActors(game);
+            commandsCount++;
+
+            // the game takes no commands while a level is generating, and checkpoints hash the level arrived on
+            updateLevelGeneration(game, true);
+
+        }
+
+        simulationTime += benchmarkSeconds(start);
+
+        // also joins a generation thread still running after a failed check
+        shutdownSimulation(game);
+        free(game);
+
+    }
+
+    fclose(file);
+
+    if (!ok) return 1;
+
+    printf("replay ok: %zu commands, %zu checkpoints verified in %.3fs (%.0f commands/s)\n",
+           commandsCount, checkpointsCount, simulationTime, commandsCount / (simulationTime > 0 ? simulationTime : 1e-9));
+
+    return 0;
+
+}
+
+// records a walk to the stairs whose descend is the last command before a checkpoint, driving
+// level generation like the frame loop does, then checks that the recording replays
+int testReplayLevelChange() {
+
+    const char* path = TextFormat("rogue-replay-test-%d.rec", (int) getpid());
+    char recordingPath[256];
+    snprintf(recordingPath, sizeof(recordingPath), "%s", path);
+
+    Game* game = calloc(1, sizeof(Game));
+    game->windowWidth = WINDOW_WIDTH;
+    game->windowHeight = WINDOW_HEIGHT;
+    game->cellSize = 32;
+
+    initSimulation(game, 12345);
+
+    if (!startRecording(game, recordingPath)) {
+        shutdownSimulation(game);
+        free(game);
+        return 1;
+    }
+
+    // path from the player to the down stairs, walked backwards from the stairs
+    Map* map = &game->map;
+    int width = map->width;
+    int start = game->player.coord.y * width + game->player.coord.x;
+    int goal = map->stairsDown.y * width + map->stairsDown.x;
+
+    int* parents = malloc((size_t) width * map->height * sizeof(int));
+    int* queue = malloc((size_t) width * map->height * sizeof(int));
+    for (int i = 0; i < width * map->height; ++i) parents[i] = -1;
+
+    size_t head = 0, tail = 0;
+    parents[start] = start;
+    queue[tail++] = start;
+
+    while (head < tail && parents[goal] == -1) {
+        int current = queue[head++];
+        for (int d = 0; d < 4; ++d) {
+            int nx = current % width + COMMAND_DIRECTIONS[d][0];
+            int ny = current / width + COMMAND_DIRECTIONS[d][1];
+            if (!isTilePassable(game, nx, ny) || parents[ny * width + nx] != -1) continue;
+            parents[ny * width + nx] = current;
+            queue[tail++] = ny * width + nx;
+        }
+    }
+
+    size_t movesCount = 0;
+    for (int i = goal; i != start; i = parents[i]) queue[movesCount++] = i;
+
+    // ascending on the first level does nothing, it pads the walk so the descend lands on a checkpoint
+    size_t interval = INPUT_RECORDING_CHECKPOINT_INTERVAL;
+    size_t padding = (interval - (movesCount + 1) % interval) % interval;
+
+    Command commands[4096];
+    size_t commandsCount = 0;
+
+    for (size_t i = 0; i < padding; ++i) commands[commandsCount++] = CommandAscend;
+
+    for (size_t i = movesCount; i-- > 0 && commandsCount < 4000;) {
+        int from = i + 1 < movesCount ? queue[i + 1] : start;
+        int dx = queue[i] % width - from % width;
+        int dy = queue[i] / width - from / width;
+        for (int d = 0; d < 4; ++d)
+            if (COMMAND_DIRECTIONS[d][0] == dx && COMMAND_DIRECTIONS[d][1] == dy) commands[commandsCount++] = CommandMoveUp + d;
+    }
+
+    commands[commandsCount++] = CommandDescend;
+    for (int i = 0; i < 8; ++i) commands[commandsCount++] = CommandMoveUp + i % 4;
+
+    free(parents);
+    free(queue);
+
+    bool pendingAtCheckpoint = false;
+
+    for (size_t i = 0; i < commandsCount; ++i) {
+
+        while (game->levelPending) {
+            updateLevelGeneration(game, false);
+            updateRecording(game);
+        }
+
+        // drops the prefetched level, so the descend has to wait for a generation started by it
+        if (commands[i] == CommandDescend) {
+            finishLevelGeneration(&game->generation, true);
+            game->generation.ready = false;
+        }
+
+        executeCommand(game, commands[i]);
+        recordCommand(game, commands[i]);
+
+        if (commands[i] == CommandDescend) pendingAtCheckpoint = game->levelPending && game->recording.checkpointPending;
+
+        updateLevelGeneration(game, false);
+        updateRecording(game);
+
+    }
+
+    bool descended = game->depth == 1;
+
+    stopRecording(game);
+    shutdownSimulation(game);
+    free(game);
+
+    int result = replayRecording(recordingPath, 1);
+    remove(recordingPath);
+
+    if (!descended) {
+        printf("ERROR: replay test never reached the down stairs\n");
+        return 1;
+    }
+
+    if (result == 0) printf("replay test ok: descend as command %zu, level %s when its checkpoint came due\n",
+                            commandsCount - 8, pendingAtCheckpoint ? "still generating" : "already generated");
+
+    return result;
+
+}
+
+#define EASING_BENCHMARK_COUNT 4096
+#define EASING_BENCHMARK_ROUNDS 4096
+#define EASING_BENCHMARK_TABLE_RESOLUTION 1024
+
+// compares scalar easing calls with batch, SIMD and lookup table variants
+void benchmarkEasing() {
+
+    static float xs[EASING_BENCHMARK_COUNT];
+    static float out[EASING_BENCHMARK_COUNT];
+    for (int i = 0; i < EASING_BENCHMARK_COUNT; ++i) xs[i] = (float) i / (EASING_BENCHMARK_COUNT - 1);
+
+    float checksum = 0;
+    size_t evaluations = (size_t) EASING_BENCHMARK_COUNT * EASING_BENCHMARK_ROUNDS;
+
+    printf("easing benchmark: %zu evaluations per variant\n", evaluations);
+
+    clock_t start = clock();
+    for (int r = 0; r < EASING_BENCHMARK_ROUNDS; ++r) {
+        for (int i = 0; i < EASING_BENCHMARK_COUNT; ++i) out[i] = easeInOutCubic(xs[i]);
+        checksum += out[r % EASING_BENCHMARK_COUNT];
+    }
+    printf("  easeInOutCubic scalar:     %.3fs\n", benchmarkSeconds(start));
+
+    start = clock();
+    for (int r = 0; r < EASING_BENCHMARK_ROUNDS; ++r) {
+        easeInOutPowBatch(3, xs, out, EASING_BENCHMARK_COUNT);
+        checksum += out[r % EASING_BENCHMARK_COUNT];
+    }
+    printf("  easeInOutPowBatch(3) SIMD: %.3fs\n", benchmarkSeconds(start));
+
+    for (int power = 1; power <= 5; ++power)
+        printf("  pow batch(%d) max error vs scalar: %g\n", power, easePowBatchMaxError(power, 100000));
+
+    EasingFunction functions[] = {easeOutBack, easeInOutSine, easeOutBounce, easeOutElastic};
+    const char* names[] = {"easeOutBack", "easeInOutSine", "easeOutBounce", "easeOutElastic"};
+
+    for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); ++f) {
+
+        start = clock();
+        for (int r = 0; r < EASING_BENCHMARK_ROUNDS; ++r) {
+            easeBatch(functions[f], xs, out, EASING_BENCHMARK_COUNT);
+            checksum += out[r % EASING_BENCHMARK_COUNT];
+        }
+        double scalarTime = benchmarkSeconds(start);
+
+        EasingTable table = easingTableCreate(functions[f], EASING_BENCHMARK_TABLE_RESOLUTION);
+
+        start = clock();
+        for (int r = 0; r < EASING_BENCHMARK_ROUNDS; ++r) {
+            easingTableSampleBatch(&table, xs, out, EASING_BENCHMARK_COUNT);
+            checksum += out[r % EASING_BENCHMARK_COUNT];
+        }
+        double tableTime = benchmarkSeconds(start);
+
+        printf("  %-15s scalar: %.3fs, table(%d): %.3fs, max error: %g\n", names[f], scalarTime,
+               table.resolution, tableTime, easingTableMaxError(&table, 100000));
+
+        easingTableFree(&table);
+
+    }
+
+    printf("checksum: %f\n", checksum);
+
+}
+
+// seeds are interleaved between threads, generator params and tile tables are only read
+void* mapGenerationWorker(void* data) {
+
+    MapGenerationWorker* worker = data;
+    MapGenerationBatch* batch = worker->batch;
+
+    Map map = {0};
+
+    for (int i = worker->threadIndex; i < batch->seedsCount; i += batch->threadsCount) {
+
+        MapStats* stats = &batch->stats[i];
+        MapGenerator* generator = batch->generator ? batch->generator : getDepthMapGenerator(0);
+
+        stats->seed = batch->firstSeed + i;
+        stats->generator = generator->name;
+        stats->width = batch->width;
+        stats->height = batch->height;
+
+        // same level as the game gets for this dungeon seed
+        Rng rng;
+        rngSeed(&rng, levelSeed(stats->seed, 0));
+
+        Coord spawn;
+        double start = wallClockSeconds();
+        bool ok = buildMap(&map, &rng, generator, &mapGeneratorParams, batch->width, batch->height, false, &spawn, stats);
+        stats->generationTime = wallClockSeconds() - start;
+
+        if (!ok) continue;
+
+        size_t histogram[TILE_TYPES_MAX_COUNT];
+        mapTypeHistogram(&map, histogram);
+
+        stats->roomsCount = map.roomsCount;
+        stats->floorCount = map.walkableCount;
+        stats->wallCount = histogram[TileTypeWall];
+        stats->corridorCount = countTilesWithState(&map, TILE_STATE_OVERRIDE);
+
+    }
+
+    freeMap(&map);
+
+    return NULL;
+
+}
+
+// generates maps for a seed range on several threads and writes per-map statistics as csv
+int runMapGenerationBatch(MapGenerationBatch* batch) {
+
+    FILE* file = fopen(batch->csvPath, "w");
+
+    if (file == NULL) {
+        printf("ERROR: can't write %s\n", batch->csvPath);
+        return 1;
+    }
+
+    printMapGeneratorParams(&mapGeneratorParams, batch->width, batch->height);
+
+    batch->stats = calloc(batch->seedsCount, sizeof(MapStats));
+
+    if (batch->threadsCount > batch->seedsCount) batch->threadsCount = batch->seedsCount;
+    if (batch->threadsCount > MAP_GENERATION_BATCH_MAX_THREADS) batch->threadsCount = MAP_GENERATION_BATCH_MAX_THREADS;
+
+    pthread_t* threads = malloc(batch->threadsCount * sizeof(pthread_t));
+    MapGenerationWorker* workers = malloc(batch->threadsCount * sizeof(MapGenerationWorker));
+
+    double start = wallClockSeconds();
+
+    for (int i = 0; i < batch->threadsCount; ++i) {
+        workers[i] = (MapGenerationWorker) {batch, i};
+        if (pthread_create(&threads[i], NULL, &mapGenerationWorker, &workers[i]) != 0) {
+            printf("ERROR: can't start generation thread\n");
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < batch->threadsCount; ++i) pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(workers);
+
+    double elapsed = wallClockSeconds() - start;
+
+    fprintf(file, "seed,generator,width,height,floor_ratio,rooms,regions,corridor_tiles,generation_ms,wall_ratio\n");
+
+    double floorRatioSum = 0;
+    double generationTimeSum = 0;
+    int failedCount = 0;
+
+    for (int i = 0; i < batch->seedsCount; ++i) {
+
+        MapStats* stats = &batch->stats[i];
+        double floorRatio = (double) stats->floorCount / (stats->width * stats->height);
+        double wallRatio = (double) stats->wallCount / (stats->width * stats->height);
+
+        // new columns go at the end, existing consumers index them by position
+        fprintf(file, "%llu,%s,%d,%d,%.4f,%zu,%d,%zu,%.3f,%.4f\n", (unsigned long long) stats->seed, stats->generator,
+                stats->width, stats->height, floorRatio, stats->roomsCount, stats->regionsCount,
+                stats->corridorCount, stats->generationTime * 1000, wallRatio);
+
+        floorRatioSum += floorRatio;
+        generationTimeSum += stats->generationTime;
+        if (stats->floorCount == 0) failedCount++;
+
+    }
+
+    fclose(file);
+
+    printf("generated %d maps on %d threads in %.3fs (%.1f maps/s), mean floor ratio %.4f, mean generation %.3fms, %d without floor\n",
+           batch->seedsCount, batch->threadsCount, elapsed, batch->seedsCount / elapsed, floorRatioSum / batch->seedsCount,
+           generationTimeSum * 1000 / batch->seedsCount, failedCount);
+    printf("statistics written to %s\n", batch->csvPath);
+
+    free(batch->stats);
+
+    return 0;
+
+}
+
+// raylib window backend
+
+bool raylibRendererInit(Renderer* renderer, Game* game) {
+
+    renderer->data = calloc(1, sizeof(RaylibRenderer));
+    ((RaylibRenderer*) renderer->data)->minimapVisible = true;
+
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_VSYNC_HINT);
+    InitWindow(game->windowWidth, game->windowHeight, "rogue v0.1");
+    SetTargetFPS(TARGET_FPS);
+
+    game->glyphFont = createGameFont("assets/fonts/DejaVuSansMono.ttf", 32);
+    // game->glyphFont = createGameFont("assets/fonts/FSEX302.ttf", 32);
+    game->uiFont = createGameFont("assets/fonts/DejaVuSans.ttf", 26);
+    game->debugFont = createGameFont("assets/fonts/Iosevka-Regular.ttf", 24);
+    loadGameFont(&game->glyphFont); // needed for the first frame, the rest load on first use
+
+    dbg_num(game->glyphFont.size);
+    dbg_num(game->glyphFont.font.baseSize);
+    dbg_num(game->cellSize);
+
+    return true;
+
+}
+
+void raylibRendererShutdown(Renderer* renderer, Game* game) {
+
+    (void) game;
+
+    RaylibRenderer* r = renderer->data;
+    if (r->mapLayerValid) UnloadRenderTexture(r->mapLayer);
+    if (r->minimapValid) UnloadTexture(r->minimap);
+    free(r->minimapPixels);
+    free(r);
+    renderer->data = NULL;
+
+    CloseWindow();
+
+}
+
+bool raylibRendererShouldClose(Renderer* renderer, Game* game) {
+    (void) renderer;
+    (void) game;
+    return WindowShouldClose();
+}
+
+Command raylibRendererPollInput(Renderer* renderer, Game* game, bool* repeated) {
+
+    RaylibRenderer* r = renderer->data;
+
+    clearDebugInfo(game);
+
+    addDebugInfoLine(game, TextFormat("FPS: %d", GetFPS()), WHITE);
+
+    game->deltaTime = GetFrameTime();
+    addDebugInfoLine(game, TextFormat("Frame time: %f", game->deltaTime), WHITE);
+    addDebugInfoLine(game, TextFormat("Depth: %d, cached levels: %zu (%zu bytes in memory)", game->depth,
+                                      game->levelCache.levelsCount, game->levelCache.memoryUsed), WHITE);
+    addDebugInfoLine(game, TextFormat("Explored chunks: %zu of %d", game->map.explored.chunksCount,
+                                      game->map.explored.chunksWidth * game->map.explored.chunksHeight), WHITE);
+
+    if (IsWindowResized()) {
+        game->windowWidth = GetScreenWidth();
+        game->windowHeight = GetScreenHeight();
+    }
+
+    if (IsKeyPressed(KEY_L)) {
+        game->useLOS = !game->useLOS;
+        markMapDirty(&game->map);
+    }
+
+    if (IsKeyPressed(KEY_F1)) {
+        game->renderGlyphsCentered = !game->renderGlyphsCentered;
+        markMapDirty(&game->map);
+    }
+
+    if (IsKeyPressed(KEY_F2)) {
+        game->lighting.enabled = !game->lighting.enabled;
+        markMapDirty(&game->map);
+    }
+
+    if (IsKeyPressed(KEY_F3)) game->ui.debugInfo.visible = !game->ui.debugInfo.visible;
+
+    if (IsKeyPressed(KEY_M)) r->minimapVisible = !r->minimapVisible;
+
+    return pollInputCommand(repeated);
+
+}
+
+// keeps the map layer in a render texture; it is fully redrawn only when the camera,
+// the window or the whole map changed, otherwise only dirty tiles are patched
+void updateMapLayer(RaylibRenderer* r, Game* game) {
+
+    if (r->mapLayerValid && (r->mapLayer.texture.width != game->windowWidth || r->mapLayer.texture.height != game->windowHeight)) {
+        UnloadRenderTexture(r->mapLayer);
+        r->mapLayerValid = false;
+    }
+
+    bool redrawAll = !r->mapLayerValid || game->map.dirty.all || !Vector2Equals(r->mapLayerCamera, game->camera.position)
+                     || r->mapLayerZoom != game->camera.zoom;
+
+    if (!r->mapLayerValid) {
+        r->mapLayer = LoadRenderTexture(game->windowWidth, game->windowHeight);
+        r->mapLayerValid = true;
+    }
+
+    if (redrawAll || game->map.dirty.count > 0) {
+
+        BeginTextureMode(r->mapLayer);
+
+        if (redrawAll) {
+            ClearBackground(BLACK);
+            renderMap(game);
+        } else renderMapDirty(game);
+
+        EndTextureMode();
+
+    }
+
+    r->mapLayerCamera = game->camera.position;
+    r->mapLayerZoom = game->camera.zoom;
+    clearDirtyTiles(&game->map);
+
+}
+
+Color minimapTileColor(Map* map, int x, int y) {
+    if (!isTileVisited(map, x, y)) return BLANK;
+    return getSeenTileGlyph(map, x, y).fgColor;
+}
+
+// uploads a map rectangle to the minimap texture in strips of MINIMAP_UPLOAD_ROWS rows
+void uploadMinimapRect(RaylibRenderer* r, Map* map, int x0, int y0, int x1, int y1) {
+
+    int width = x1 - x0 + 1;
+
+    for (int stripY = y0; stripY <= y1; stripY += MINIMAP_UPLOAD_ROWS) {
+
+        int rows = y1 - stripY + 1 < MINIMAP_UPLOAD_ROWS ? y1 - stripY + 1 : MINIMAP_UPLOAD_ROWS;
+
+        for (int y = 0; y < rows; ++y)
+            for (int x = 0; x < width; ++x)
+                r->minimapPixels[y * width + x] = minimapTileColor(map, x0 + x, stripY + y);
+
+        UpdateTextureRec(r->minimap, (Rectangle) {x0, stripY, width, rows}, r->minimapPixels);
+
+    }
+
+}
+
+typedef struct {
+    RaylibRenderer* renderer;
+    Map* map;
+} MinimapUpload;
 
+void uploadMinimapChunk(void* data, int x0, int y0, int x1, int y1) {
+    MinimapUpload* upload = data;
+    uploadMinimapRect(upload->renderer, upload->map, x0, y0, x1, y1);
 }
 
-void calcLOS(Game* game, const int x, const int y, const int boxRadius) {
+// rebuilt only for a new map, otherwise just the bounding box of the
+// dirty tiles is uploaded; must run before the map layer clears the dirty tiles
+void updateMinimap(RaylibRenderer* r, Game* game) {
 
-    clearLOS(game);
+    Map* map = &game->map;
+
+    if (r->minimapValid && (r->minimap.width != map->width || r->minimap.height != map->height)) {
+        UnloadTexture(r->minimap);
+        r->minimapValid = false;
+    }
 
-    int hr = (int) floor((float) boxRadius / 2);
+    if (!r->minimapValid || map->dirty.all) {
 
-    int xx = x - hr;
-    if (xx < 0) xx = 0;
+        // starts blank, so only explored chunks need uploading
+        if (r->minimapValid) UnloadTexture(r->minimap);
 
-    int yy = y - hr;
-    if (yy < 0) yy = 0;
+        Image image = GenImageColor(map->width, map->height, BLANK);
+        r->minimap = LoadTextureFromImage(image);
+        UnloadImage(image);
+        r->minimapPixels = realloc(r->minimapPixels, (size_t) map->width * MINIMAP_UPLOAD_ROWS * sizeof(Color));
+        r->minimapValid = true;
+
+        MinimapUpload upload = {r, map};
+        forEachExploredChunk(map, (Coord) {0, 0}, (Coord) {map->width - 1, map->height - 1}, &uploadMinimapChunk, &upload);
+        return;
 
-    for (int ty = yy; ty < y + hr; ty++) {
-        for (int tx = xx; tx < x + hr; tx++) {
-            bresenham(game, x, y, tx, ty, &plot);
-        }
     }
 
-}
+    if (map->dirty.count == 0) return;
 
-void generateMap(Game* game, int width, int height) {
+    int x0 = map->width, y0 = map->height, x1 = -1, y1 = -1;
 
-    if (game->map.width != 0) {
-        for (int y = 0; y < game->map.height; ++y) {
-            free(game->map.tiles[y]);
-        }
-        free(game->map.tiles);
+    for (size_t i = 0; i < map->dirty.count; ++i) {
+        int x = map->dirty.tiles[i] % map->width;
+        int y = map->dirty.tiles[i] / map->width;
+        if (x < x0) x0 = x;
+        if (x > x1) x1 = x;
+        if (y < y0) y0 = y;
+        if (y > y1) y1 = y;
     }
 
-    game->map.width = width;
-    game->map.height = height;
+    uploadMinimapRect(r, map, x0, y0, x1, y1);
 
-    game->map.tiles = malloc(height * sizeof(Tile*));
-    for (int y = 0; y < height; ++y) {
-        game->map.tiles[y] = malloc(width * sizeof(Tile));
-    }
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            *mapGetTile(&game->map, x, y) = createTile(TileTypeWall);
-        }
-    }
+Rectangle minimapScreenRect(Game* game) {
 
-    int currentX = GetRandomValue(MAP_GENERATOR_BORDERS_PADDING, game->map.width - MAP_GENERATOR_BORDERS_PADDING);
-    int currentY = GetRandomValue(MAP_GENERATOR_BORDERS_PADDING, game->map.height - MAP_GENERATOR_BORDERS_PADDING);
+    float scale = fminf((float) MINIMAP_MAX_SIZE / game->map.width, (float) MINIMAP_MAX_SIZE / game->map.height);
+    float width = game->map.width * scale;
+    float height = game->map.height * scale;
 
-    bool updateDirection = true;
+    return (Rectangle) {game->windowWidth - MINIMAP_MARGIN - width, MINIMAP_MARGIN, width, height};
 
-    int directionX = 0;
-    int directionY = 0;
+}
 
-    int steps = 0;
-    int roomCooldown = 0;
+// clicking the minimap moves the camera there until the player moves again
+void handleMinimapClick(RaylibRenderer* r, Game* game) {
 
-    int rooms[MAX_ROOMS_COUNT(game->map.width, game->map.height)];
-    size_t roomsCount = 0;
+    Rectangle rect = minimapScreenRect(game);
+    if (!r->minimapVisible || !IsMouseButtonPressed(MOUSE_BUTTON_LEFT) || !CheckCollisionPointRec(game->mouse, rect)) return;
 
-    printf("map size: %dx%d\n", game->map.width, game->map.height);
-    printf("min room size: %dx%d\n", ROOM_MIN_WIDTH, ROOM_MIN_HEIGHT);
-    printf("max possible rooms count: %d\n", MAX_ROOMS_COUNT(game->map.width, game->map.height));
+    float scale = rect.width / game->map.width;
+    Coord coord = {(game->mouse.x - rect.x) / scale, (game->mouse.y - rect.y) / scale};
 
-    while(1) {
+    r->focused = true;
+    r->focus = coord2vector(game, coord);
+    r->focusPlayerCoord = game->player.coord;
 
-        if (steps >= MAP_GENERATOR_ITERATIONS_COUNT) break;
+}
 
-        if (updateDirection) {
+void renderMinimap(RaylibRenderer* r, Game* game) {
 
-            updateDirection = false;
-            int randomDirection = GetRandomValue(0, 1) == 0 ? -1 : 1;
+    if (!r->minimapVisible || !r->minimapValid) return;
 
-            if (directionX != 0) {
-                directionX = 0;
-                directionY = randomDirection;
-            } else if (directionY != 0) {
-                directionX = randomDirection;
-                directionY = 0;
-            } else {
-                if (GetRandomValue(0, 1) == 0) directionX = randomDirection;
-                else directionY = randomDirection;
-            }
-        }
+    Rectangle rect = minimapScreenRect(game);
+    float scale = rect.width / game->map.width;
 
-        int nextX = currentX + directionX;
-        int nextY = currentY + directionY;
+    DrawRectangleRec(rect, Fade(BLACK, 0.85f));
+    DrawTexturePro(r->minimap, (Rectangle) {0, 0, game->map.width, game->map.height}, rect, (Vector2) {0, 0}, 0, WHITE);
 
-        if (nextX >= game->map.width - MAP_GENERATOR_BORDERS_PADDING || nextX < MAP_GENERATOR_BORDERS_PADDING
-            || nextY >= game->map.height - MAP_GENERATOR_BORDERS_PADDING || nextY < MAP_GENERATOR_BORDERS_PADDING) {
-            updateDirection = true;
-            continue;
-        }
+    // visible part of the map
+    Coord first = screen2coord(game, (Vector2) {0, 0});
+    Coord last = screen2coord(game, (Vector2) {game->windowWidth, game->windowHeight});
+    Rectangle view = {rect.x + first.x * scale, rect.y + first.y * scale, (last.x - first.x + 1) * scale, (last.y - first.y + 1) * scale};
+    DrawRectangleLinesEx(GetCollisionRec(view, rect), 1, Fade(WHITE, 0.5f));
 
-        if (GetRandomValue(0, 100) <= MAP_GENERATOR_STEP_DIRECTION_CHANGE_CHANCE) {
-            updateDirection = true;
-            // continue;
-        }
+    float markerSize = fmaxf(scale, 2);
 
-        currentX = nextX;
-        currentY = nextY;
+    for (size_t i = 0; i < game->actors_count; ++i) {
+        Coord c = game->actors[i].coord;
+        if (checkMapBounds(&game->map, c.x, c.y) && isTileInLOS(mapGetTile(&game->map, c.x, c.y)))
+            DrawRectangle(rect.x + c.x * scale, rect.y + c.y * scale, markerSize, markerSize, RED);
+    }
 
-        Tile* currentTile = mapGetTile(&game->map, currentX, currentY);
+    DrawRectangle(rect.x + game->player.coord.x * scale, rect.y + game->player.coord.y * scale, markerSize, markerSize, GREEN);
 
-        bool isInRoom = (directionY != 0 && currentX + 1 < game->map.width && mapGetTile(&game->map, currentX + 1, currentY)->type != TileTypeWall)
-                        || (directionY != 0 && currentX - 1 >= 0 && mapGetTile(&game->map, currentX - 1, currentY)->type != TileTypeWall)
-                        || (directionX != 0 && currentY + 1 < game->map.height && mapGetTile(&game->map, currentX, currentY + 1)->type != TileTypeWall)
-                        || (directionX != 0 && currentY - 1 >= 0 && mapGetTile(&game->map, currentX, currentY - 1)->type != TileTypeWall);
+    DrawRectangleLinesEx(rect, 1, DARKGRAY);
 
-        if (!isInRoom && roomCooldown == 0 && GetRandomValue(0, 100) <= MAP_GENERATOR_STEP_ROOM_CHANCE) {
+}
 
-           int roomWidth = GetRandomValue(ROOM_MIN_WIDTH, ROOM_MAX_WIDTH);
-           int roomHeight = GetRandomValue(ROOM_MIN_HEIGHT, ROOM_MAX_HEIGHT);
-           int roomHalfWidth = floor((float) roomWidth / 2.0f);
-           int roomHalfHeight = floor((float) roomHeight / 2.0f);
+void raylibRendererRenderFrame(Renderer* renderer, Game* game) {
 
-           int roomStartX = currentX - roomHalfWidth;
-           if (roomStartX < 0) roomStartX = 0;
+    RaylibRenderer* r = renderer->data;
 
-           int roomStartY = currentY - roomHalfHeight;
-           if (roomStartY < 0) roomStartY = 0;
+    Vector2 mouse = GetMousePosition();
+    game->mouse = mouse;
+    game->mouseCoord = screen2coord(game, mouse);
 
-           int roomEndX = roomStartX + roomWidth;
-           if (roomEndX >= game->map.width) roomEndX = game->map.width - 1;
+    handleMinimapClick(r, game);
 
-           int roomEndY = roomStartY + roomHeight;
-           if (roomEndY >= game->map.height) roomEndY = game->map.height - 1;
+    float wheel = GetMouseWheelMove();
+    if (wheel != 0) cameraZoom(game, powf(CAMERA_ZOOM_STEP, wheel));
 
-           for (int roomY = roomStartY; roomY <= roomEndY; ++roomY) {
-               for (int roomX = roomStartX; roomX <= roomEndX; ++roomX) {
+    // zoomed out far enough, the whole map is one stretched draw of the minimap texture
+    bool useLOD = screenCellSize(game) < CAMERA_LOD_CELL_SIZE;
 
-                   Tile* t = mapGetTile(&game->map, roomX, roomY);
-                   *t = createTile(TileTypeFloor);
-                   t->glyph.fgColor = DARKGRAY;
+    updateMinimap(r, game);
 
-               }
-           }
+    if (useLOD) {
+        r->mapLayerZoom = 0; // redraw the glyph layer when zooming back in
+        clearDirtyTiles(&game->map);
+    } else updateMapLayer(r, game);
 
-           rooms[roomsCount * 4 + 0] = roomStartX;
-           rooms[roomsCount * 4 + 1] = roomStartY;
-           rooms[roomsCount * 4 + 2] = roomEndX;
-           rooms[roomsCount * 4 + 3] = roomEndY;
-           ++roomsCount;
+    BeginDrawing();
 
-           roomCooldown = MAP_GENERATOR_STEP_ROOM_COOLDOWN;
+    ClearBackground(BLACK);
 
-        }
+    if (useLOD) {
 
-        if (currentTile->type == TileTypeWall) {
-            *currentTile = createTile(TileTypeFloor);
-            currentTile->glyph.fgColor = YELLOW;
-        }
+        Vector2 origin = coord2screen(game, (Coord) {0, 0});
+        Rectangle mapRect = {origin.x, origin.y, game->map.width * screenCellSize(game), game->map.height * screenCellSize(game)};
+        DrawTexturePro(r->minimap, (Rectangle) {0, 0, game->map.width, game->map.height}, mapRect, (Vector2) {0, 0}, 0, WHITE);
 
-        steps++;
-        if (roomCooldown > 0) roomCooldown--;
+        float markerSize = fmaxf(screenCellSize(game), 2);
+        DrawRectangleV(coord2screen(game, game->player.coord), (Vector2) {markerSize, markerSize}, GREEN);
 
-    }
+    } else {
 
-    // for (size_t i = 0; i < roomsCount; ++i) {
-    //     int roomX = rooms[i * 4 + 0];
-    //     int roomY = rooms[i * 4 + 1];
-    //     int roomW = rooms[i * 4 + 2] - roomX;
-    //     int roomH = rooms[i * 4 + 3] - roomY;
-    //     printf("generated room %zu: %dx%d\n", i, roomW, roomH);
-    // }
+        // render textures are stored upside down
+        Rectangle layerRect = {0, 0, r->mapLayer.texture.width, -r->mapLayer.texture.height};
+        DrawTextureRec(r->mapLayer.texture, layerRect, (Vector2) {0, 0}, WHITE);
 
-    // place walls at map edges
+        renderActor(game, &game->player);
 
-    for (int y = 0; y < game->map.height; ++y) {
-        for (int x = 0; x < game->map.width; ++x) {
-            if (y == 0 || y == game->map.height - 1 || x == 0 || x == game->map.width - 1) {
-                *mapGetTile(&game->map, x, y) = createTile(TileTypeWall);
-            }
-        }
     }
 
-    // place player at random room
+    renderUI(game);
+    renderMinimap(r, game);
 
-    int px, py;
-    while(1) {
-        size_t randomRoom = GetRandomValue(0, roomsCount);
-        px = GetRandomValue(rooms[randomRoom + 0], rooms[randomRoom + 2]);
-        py = GetRandomValue(rooms[randomRoom + 1], rooms[randomRoom + 3]);
-        if (mapGetTile(&game->map, px, py)->type != TileTypeWall) break;
-    }
+    if (r->focused && (r->focusPlayerCoord.x != game->player.coord.x || r->focusPlayerCoord.y != game->player.coord.y)) r->focused = false;
 
-    game->player.coord.x = px;
-    game->player.coord.y = py;
-    game->player.glyph.position = coord2vector(game, game->player.coord);
+    cameraTarget(game, r->focused ? r->focus : game->player.glyph.position);
+    cameraUpdate(game);
 
-    cameraPosition(game, game->player.glyph.position);
-    cameraTarget(game, game->player.glyph.position);
+    // DrawFPS(10, 10);
 
-    calcLOS(game, game->player.coord.x, game->player.coord.y, game->player.visionRadius);
+    EndDrawing();
 
 }
 
-void updateActors(Game* game) {
-    (void) game;
+Renderer createRaylibRenderer() {
+    Renderer renderer = {0};
+    renderer.name = "raylib";
+    renderer.init = &raylibRendererInit;
+    renderer.shutdown = &raylibRendererShutdown;
+    renderer.shouldClose = &raylibRendererShouldClose;
+    renderer.pollInput = &raylibRendererPollInput;
+    renderer.renderFrame = &raylibRendererRenderFrame;
+    return renderer;
 }
 
-void renderGlyph(Game* game, Coord coord, Glyph* glyph) {
+// terminal backend: one map tile per character cell, only changed cells are written each frame
 
-    int cellSize = game->cellSize;
-    char chBuffer[2] = {glyph->ch}; // because DrawTextEx requires char*
+#ifndef _WIN32
 
-    Vector2 chTargetPosition = coord2vector(game, coord);
+void terminalWrite(TerminalRenderer* t, const char* data, size_t size) {
 
-    if (game->renderGlyphsCentered) {
-        GlyphInfo glyphInfo = GetGlyphInfo(game->glyphFont.font, (int) glyph->ch);
-        Vector2 textSize = MeasureTextEx(game->glyphFont.font, chBuffer, game->glyphFont.size, game->glyphFont.spacing);
-        chTargetPosition = Vector2Add(chTargetPosition, (Vector2) {(float) cellSize / 2 - (float) glyphInfo.offsetX / 2, (float) cellSize / 2 - (float) glyphInfo.offsetY / 2});
-        chTargetPosition = Vector2Subtract(chTargetPosition, Vector2Scale(textSize, 0.5));
+    if (t->outputSize + size > t->outputCapacity) {
+        while (t->outputSize + size > t->outputCapacity) t->outputCapacity = t->outputCapacity ? t->outputCapacity * 2 : 4096;
+        t->output = realloc(t->output, t->outputCapacity);
     }
 
-    if (glyph->animateMovement && !Vector2Equals(glyph->position, chTargetPosition)) {
-        glyph->position = Vector2Lerp(glyph->position, chTargetPosition, easeOutBack(glyph->animationTime));
-        glyph->animationTime += game->deltaTime;
-    } else glyph->position = chTargetPosition;
+    memcpy(t->output + t->outputSize, data, size);
+    t->outputSize += size;
 
-    Vector2 bgTargetPosition = glyph->position;
+}
 
-    Vector2 chRenderingPosition = vector2screen(game, glyph->position);
-    Vector2 bgRenderingPosition = vector2screen(game, bgTargetPosition);
+void terminalWriteString(TerminalRenderer* t, const char* text) {
+    terminalWrite(t, text, strlen(text));
+}
 
-    DrawRectangle(bgRenderingPosition.x, bgRenderingPosition.y, cellSize, cellSize, glyph->bgColor);
-    DrawTextEx(game->glyphFont.font, chBuffer, chRenderingPosition, game->glyphFont.size, game->glyphFont.spacing, glyph->fgColor);
+void terminalFlush(TerminalRenderer* t) {
 
-}
+    size_t written = 0;
 
-// TODO: add Map* as argument to renderMap()
+    while (written < t->outputSize) {
+        ssize_t result = write(STDOUT_FILENO, t->output + written, t->outputSize - written);
+        if (result <= 0) break;
+        written += result;
+    }
 
-void renderMap(Game* game) {
-    for (int y = 0; y < game->map.height; ++y) {
-        for (int x = 0; x < game->map.width; ++x) {
+    t->outputSize = 0;
 
-            float alpha = 1.0f;
+}
 
-            Tile* t = mapGetTile(&game->map, x, y);
+bool terminalCellEquals(TerminalCell a, TerminalCell b) {
+    return a.ch == b.ch && colorEquals(a.fgColor, b.fgColor) && colorEquals(a.bgColor, b.bgColor);
+}
 
-            if (game->useLOS && !t->isInLOS && !t->isVisited) continue;
-            if (!t->isInLOS && t->isVisited) alpha = 0.05f; // TODO: factor out faded alpha const
+// terminals have no alpha, so colors are blended over the cell background up front
+Color terminalBlend(Color color, Color bgColor) {
+    float a = color.a / 255.0f;
+    return (Color) {
+        (unsigned char) (color.r * a + bgColor.r * (1 - a)),
+        (unsigned char) (color.g * a + bgColor.g * (1 - a)),
+        (unsigned char) (color.b * a + bgColor.b * (1 - a)),
+        255
+    };
+}
 
-            t->glyph.fgColor = Fade(t->glyph.fgColor, alpha);
-            renderGlyph(game, (Coord) {x, y}, &t->glyph);
+void terminalResize(TerminalRenderer* t) {
 
-        }
+    struct winsize size = {0};
+    int width = 80, height = 24;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+        width = size.ws_col;
+        height = size.ws_row;
     }
+
+    if (width == t->width && height == t->height && t->front != NULL) return;
+
+    t->width = width;
+    t->height = height;
+
+    free(t->front);
+    free(t->back);
+    t->front = malloc((size_t) width * height * sizeof(TerminalCell));
+    t->back = malloc((size_t) width * height * sizeof(TerminalCell));
+
+    // impossible cell contents force the first frame after a resize to repaint everything
+    for (int i = 0; i < width * height; ++i) t->front[i] = (TerminalCell) {0, BLANK, BLANK};
+    t->backValid = false;
+
+    terminalWriteString(t, "\x1b[0m\x1b[2J");
+
 }
 
-void renderActor(Game* game, Actor* actor) {
-    renderGlyph(game, actor->coord, &actor->glyph);
+void terminalSetCell(TerminalRenderer* t, int x, int y, char ch, Color fgColor, Color bgColor) {
+    if (x < 0 || x >= t->width || y < 0 || y >= t->height) return;
+    t->back[y * t->width + x] = (TerminalCell) {ch, terminalBlend(fgColor, bgColor), bgColor};
 }
 
-void highlightTile(Game* game, Coord coord, Color color) {
-    Vector2 hoverPosition = coord2screen(game, coord);
-    // Rectangle rect = {hoverPosition.x, hoverPosition.y, game->cellSize, game->cellSize};
-    // DrawRectangleRoundedLines(rect, 1, 10, 1, color);
-    DrawRectangleLines(hoverPosition.x, hoverPosition.y, game->cellSize, game->cellSize, color);
+void terminalDrawText(TerminalRenderer* t, int x, int y, const char* text, Color fgColor, Color bgColor) {
+    for (size_t i = 0; text[i] != '\0'; ++i) terminalSetCell(t, x + i, y, text[i], fgColor, bgColor);
 }
 
-void renderCurrentTileInfo(Game* game) {
+// emits only changed cells, skipping cursor moves between adjacent cells and
+// color changes between cells sharing colors
+void terminalPresent(TerminalRenderer* t) {
 
-    if (checkMapBounds(&game->map, game->mouseCoord.x, game->mouseCoord.y)) {
+    int cursorX = -1, cursorY = -1;
+    bool hasColors = false;
+    Color fgColor = BLACK, bgColor = BLACK;
+    char sequence[64];
 
-        Tile* t = mapGetTile(&game->map, game->mouseCoord.x, game->mouseCoord.y);
+    for (int y = 0; y < t->height; ++y) {
+        for (int x = 0; x < t->width; ++x) {
 
-        if (!t->isInLOS && !t->isVisited) return;
+            int i = y * t->width + x;
+            TerminalCell cell = t->back[i];
 
-        highlightTile(game, game->mouseCoord, YELLOW);
+            if (terminalCellEquals(cell, t->front[i])) continue;
 
-        char* tileTypeText;
-        switch(t->type) {
-        case TileTypeEmpty:
-            tileTypeText = "Empty";
-            break;
-        case TileTypeWall:
-            tileTypeText = "Wall";
-            break;
-        case TileTypeFloor:
-            tileTypeText = "Floor";
-            break;
-        default:
-            tileTypeText = "<Unknown>";
-            break;
-        }
+            if (x != cursorX || y != cursorY) {
+                int size = snprintf(sequence, sizeof(sequence), "\x1b[%d;%dH", y + 1, x + 1);
+                terminalWrite(t, sequence, size);
+            }
 
-        const char* currentTileText = TextFormat("Tile [%c] - %s", t->glyph.ch, tileTypeText);
-        Vector2 size = MeasureTextEx(game->uiFont.font, currentTileText, game->uiFont.size, game->uiFont.spacing);
-        renderTextBg(&game->uiFont, currentTileText, (Vector2) {10, game->windowHeight - 10 - size.y}, YELLOW, Fade(BLACK, 0.85f));
+            if (!hasColors || !colorEquals(cell.fgColor, fgColor)) {
+                int size = snprintf(sequence, sizeof(sequence), "\x1b[38;2;%d;%d;%dm", cell.fgColor.r, cell.fgColor.g, cell.fgColor.b);
+                terminalWrite(t, sequence, size);
+                fgColor = cell.fgColor;
+            }
+
+            if (!hasColors || !colorEquals(cell.bgColor, bgColor)) {
+                int size = snprintf(sequence, sizeof(sequence), "\x1b[48;2;%d;%d;%dm", cell.bgColor.r, cell.bgColor.g, cell.bgColor.b);
+                terminalWrite(t, sequence, size);
+                bgColor = cell.bgColor;
+            }
+
+            hasColors = true;
+
+            terminalWrite(t, &cell.ch, 1);
+            t->front[i] = cell;
+
+            cursorX = x + 1;
+            cursorY = y;
 
+        }
     }
 
+    terminalFlush(t);
+
 }
 
-bool plotPathToMousePosition(Game* game, int x, int y) {
-    highlightTile(game, (Coord) {x, y}, GREEN);
-    return true;
+double terminalMonotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
 }
 
-void renderPathToMousePosition(Game* game) {
+// leaves raw mode and the alternate screen; only async-signal-safe calls, it also runs from signal handlers
+void restoreTerminal() {
 
-    bresenham(game, game->player.coord.x, game->player.coord.y, game->mouseCoord.x, game->mouseCoord.y, &plotPathToMousePosition);
+    if (!terminalRawMode) return;
+    terminalRawMode = 0;
+
+    const char* reset = "\x1b[0m\x1b[?25h\x1b[?1049l";
+    ssize_t written = write(STDOUT_FILENO, reset, strlen(reset));
+    (void) written;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &terminalSavedAttributes);
 
 }
 
-void renderDebugInfo(Game* game, DebugInfo* debugInfo) {
+void restoreTerminalOnSignal(int sig) {
+    restoreTerminal();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
 
-    DebugInfo di = *debugInfo;
+bool terminalRendererInit(Renderer* renderer, Game* game) {
 
-    if (!di.visible) return;
+    (void) game;
 
-    float lineY = 0;
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) || tcgetattr(STDIN_FILENO, &terminalSavedAttributes) != 0) {
+        printf("ERROR: terminal renderer needs an interactive terminal\n");
+        return false;
+    }
 
-    for (size_t i = 0; i < di.linesCount; ++i) {
+    TerminalRenderer* t = calloc(1, sizeof(TerminalRenderer));
+    renderer->data = t;
 
-        DebugInfoLine line = di.lines[i];
+    // error paths exit(1) from anywhere, the terminal has to come back from raw mode on those too
+    static bool handlersInstalled = false;
 
-        Vector2 position = {di.offset.x, di.offset.y + lineY};
-        Vector2 textSize = renderTextBg(&game->debugFont, line.text, position, line.color, di.bgColor);
+    if (!handlersInstalled) {
+        handlersInstalled = true;
+        atexit(&restoreTerminal);
+        const int signals[] = {SIGTERM, SIGHUP, SIGINT, SIGQUIT, SIGABRT, SIGSEGV, SIGBUS, SIGFPE};
+        for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); ++i) signal(signals[i], &restoreTerminalOnSignal);
+    }
 
-        lineY += textSize.y;
+    struct termios raw = terminalSavedAttributes;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    terminalRawMode = 1;
 
-    }
+    // alternate screen, hidden cursor
+    terminalWriteString(t, "\x1b[?1049h\x1b[?25l");
+    terminalResize(t);
+    terminalFlush(t);
+
+    t->lastFrameTime = terminalMonotonicSeconds();
+
+    return true;
 
 }
 
-void addDebugInfoLine(Game* game, const char* text, Color color) {
+void terminalRendererShutdown(Renderer* renderer, Game* game) {
+
+    (void) game;
+
+    TerminalRenderer* t = renderer->data;
 
-    DebugInfoLine line = {0};
-    line.text = (char*) text;
-    line.color = color;
+    terminalFlush(t);
+    restoreTerminal();
 
-    game->ui.debugInfo.lines[game->ui.debugInfo.linesCount] = line;
-    game->ui.debugInfo.linesCount++;
+    free(t->front);
+    free(t->back);
+    free(t->output);
+    free(t);
+    renderer->data = NULL;
 
 }
 
-void clearDebugInfo(Game* game) {
-    game->ui.debugInfo.linesCount = 0;
+bool terminalRendererShouldClose(Renderer* renderer, Game* game) {
+    (void) game;
+    TerminalRenderer* t = renderer->data;
+    return t->quit;
 }
 
-void renderUI(Game* game) {
+Command terminalRendererPollInput(Renderer* renderer, Game* game, bool* repeated) {
+
+    TerminalRenderer* t = renderer->data;
+
+    *repeated = false;
+
+    char key;
+    if (read(STDIN_FILENO, &key, 1) != 1) return CommandNone;
+
+    switch (key) {
+    case 'w': return CommandMoveUp;
+    case 's': return CommandMoveDown;
+    case 'a': return CommandMoveLeft;
+    case 'd': return CommandMoveRight;
+    case 'W': return CommandRunUp;
+    case 'S': return CommandRunDown;
+    case 'A': return CommandRunLeft;
+    case 'D': return CommandRunRight;
+    case 'x': return CommandAutoExplore;
+    case 'r': return CommandRegenerateMap;
+    case '>': return CommandDescend;
+    case '<': return CommandAscend;
+    case 'l':
+        game->useLOS = !game->useLOS;
+        markMapDirty(&game->map);
+        return CommandNone;
+    case 'q':
+    case 3: // ctrl-c, signals are off in raw mode
+        t->quit = true;
+        return CommandNone;
+    case '\x1b': {
+        char sequence[2];
+        if (read(STDIN_FILENO, &sequence[0], 1) != 1) {
+            t->quit = true;
+            return CommandNone;
+        }
+        if (read(STDIN_FILENO, &sequence[1], 1) != 1 || sequence[0] != '[') return CommandNone;
+        switch (sequence[1]) {
+        case 'A': return CommandMoveUp;
+        case 'B': return CommandMoveDown;
+        case 'D': return CommandMoveLeft;
+        case 'C': return CommandMoveRight;
+        default: return CommandNone;
+        }
+    }
+    default:
+        return CommandNone;
+    }
 
-    // renderPathToMousePosition(game);
-    renderCurrentTileInfo(game);
+}
 
-    renderDebugInfo(game, &game->ui.debugInfo);
+void terminalDrawMapTile(TerminalRenderer* t, Game* game, int mapX, int mapY) {
 
-}
+    int x = mapX - t->origin.x;
+    int y = mapY - t->origin.y;
 
-bool moveActor(Game* game, Actor* actor, int dx, int dy) {
+    if (x < 0 || x >= t->width || y < 0 || y >= t->height - TERMINAL_STATUS_LINES) return;
 
-    int tx = actor->coord.x + dx;
-    int ty = actor->coord.y + dy;
+    t->back[y * t->width + x] = (TerminalCell) {' ', BLACK, BLACK};
 
-    if (tx < 0 || tx >= game->map.width || ty < 0 || ty >= game->map.height) return false;
+    if (!checkMapBounds(&game->map, mapX, mapY)) return;
 
-    Tile* tile = mapGetTile(&game->map, tx, ty);
+    Tile* tile = mapGetTile(&game->map, mapX, mapY);
 
-    if (isTileBlocksMovement(tile)) return false;
+    bool visited = isTileVisited(&game->map, mapX, mapY);
 
-    actor->coord.x = tx;
-    actor->coord.y = ty;
-    actor->glyph.animationTime = 0;
+    if (game->useLOS && !isTileInLOS(tile) && !visited) return;
 
-    return true;
+    float alpha = !isTileInLOS(tile) && visited ? VISITED_TILE_ALPHA : 1.0f;
+    Glyph glyph = getSeenTileGlyph(&game->map, mapX, mapY);
+    if (isTileInLOS(tile)) glyph.fgColor = applyLighting(game, mapX, mapY, glyph.fgColor);
+    terminalSetCell(t, x, y, glyph.ch, Fade(glyph.fgColor, alpha), glyph.bgColor);
 
 }
 
-void initPlayer(Actor* player) {
+// the back buffer persists between frames: it is rebuilt when the view scrolls or the whole map
+// changed, otherwise only dirty tiles are redrawn, and idle frames skip the diff entirely
+void terminalRendererRenderFrame(Renderer* renderer, Game* game) {
 
-    player->glyph.ch = '@';
-    player->glyph.fgColor = WHITE;
-    player->glyph.bgColor = BLACK;
-    player->glyph.animateMovement = true;
-    player->glyph.animationTime = 0;
-    // player->glyph.t = LERPING_FACTOR(0.5f);
-    // player->glyph.defaultT = player->glyph.t;
-    player->visionRadius = 20;
+    TerminalRenderer* t = renderer->data;
 
-}
+    terminalResize(t);
 
-bool movePlayer(Game* game, int dx, int dy) {
+    Actor* player = &game->player;
+
+    int viewHeight = t->height - TERMINAL_STATUS_LINES;
+    Coord origin = {player->coord.x - t->width / 2, player->coord.y - viewHeight / 2};
+
+    bool changed = false;
+
+    if (!t->backValid || game->map.dirty.all || origin.x != t->origin.x || origin.y != t->origin.y) {
+
+        t->origin = origin;
+        t->backValid = true;
+
+        for (int y = 0; y < viewHeight; ++y)
+            for (int x = 0; x < t->width; ++x)
+                terminalDrawMapTile(t, game, origin.x + x, origin.y + y);
+
+        changed = true;
+
+    } else if (game->map.dirty.count > 0) {
+
+        for (size_t i = 0; i < game->map.dirty.count; ++i) {
+            int index = game->map.dirty.tiles[i];
+            terminalDrawMapTile(t, game, index % game->map.width, index / game->map.width);
+        }
+
+        changed = true;
 
-    if (moveActor(game, &game->player, dx, dy)) {
-        calcLOS(game, game->player.coord.x, game->player.coord.y, game->player.visionRadius);
-        return true;
     }
 
-    return false;
+    clearDirtyTiles(&game->map);
 
-}
+    if (changed) terminalSetCell(t, player->coord.x - origin.x, player->coord.y - origin.y, player->glyph.ch, player->glyph.fgColor, player->glyph.bgColor);
 
-void longMovePlayer(Game* game, int dx, int dy) {
-    while (movePlayer(game, dx, dy));
-}
+    const char* status = game->levelPending
+        ? TextFormat(" generating level %d ...", game->depth + 1)
+        : TextFormat(" depth %d  %d,%d  wasd move, WASD run, x explore, <> stairs, r new dungeon, l LOS, q quit", game->depth, player->coord.x, player->coord.y);
 
-int main(int argc, char** argv) {
+    if (changed || strcmp(status, t->status) != 0) {
 
-    (void) argc;
-    (void) argv;
+        snprintf(t->status, sizeof(t->status), "%s", status);
 
-    SetRandomSeed(time(NULL));
+        for (int x = 0; x < t->width; ++x) terminalSetCell(t, x, t->height - 1, ' ', YELLOW, DARKGRAY);
+        terminalDrawText(t, 0, t->height - 1, status, YELLOW, DARKGRAY);
 
-    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_VSYNC_HINT);
-    InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "rogue v0.1");
-    SetTargetFPS(TARGET_FPS);
+        terminalPresent(t);
 
-    Game game = {0};
-    game.windowWidth = WINDOW_WIDTH;
-    game.windowHeight = WINDOW_HEIGHT;
-    game.cellSize = 32;
+    }
 
-    game.glyphFont = createGameFont("assets/fonts/DejaVuSansMono.ttf", 32);
-    // game.glyphFont = createGameFont("assets/fonts/FSEX302.ttf", 32);
-    game.uiFont = createGameFont("assets/fonts/DejaVuSans.ttf", 26);
-    game.debugFont = createGameFont("assets/fonts/Iosevka-Regular.ttf", 24);
+    // frame pacing, the terminal has no vsync
+    double time = terminalMonotonicSeconds();
+    double remaining = 1.0 / TARGET_FPS - (time - t->lastFrameTime);
 
-    game.useLOS = true;
-    game.renderGlyphsCentered = true;
+    if (remaining > 0) {
+        struct timespec sleep = {0, (long) (remaining * 1e9)};
+        nanosleep(&sleep, NULL);
+        time += remaining;
+    }
 
-    game.ui.debugInfo.offset = (Vector2) { 5, 5 };
-    game.ui.debugInfo.bgColor = Fade(BLACK, 0.65f);
+    t->lastFrameTime = time;
 
-    dbg_num(game.glyphFont.size);
-    dbg_num(game.glyphFont.font.baseSize);
-    dbg_num(game.cellSize);
+}
 
-    initPlayer(&game.player);
-    generateMap(&game, MAP_WIDTH, MAP_HEIGHT);
+#endif
+
+Renderer createTerminalRenderer() {
+    Renderer renderer = {0};
+    renderer.name = "terminal";
+#ifndef _WIN32
+    renderer.init = &terminalRendererInit;
+    renderer.shutdown = &terminalRendererShutdown;
+    renderer.shouldClose = &terminalRendererShouldClose;
+    renderer.pollInput = &terminalRendererPollInput;
+    renderer.renderFrame = &terminalRendererRenderFrame;
+#endif
+    return renderer;
+}
 
-    // for (int i = 0; i < 512; ++i) {
-    //     int ch = codepoints[i];
-    //     char tempBuf[2];
-    //     sprintf(tempBuf, "%c", ch);
-    //     Vector2 charSize = MeasureTextEx(game.glyphFont, tempBuf, game.glyphFontSize, 1);
-    //     printf("%c %dx%d\n", ch, (int) charSize.x, (int) charSize.y);
-    // }
+void runGame(Game* game, Renderer* renderer) {
 
-    while (!WindowShouldClose()) {
+    while (!renderer->shouldClose(renderer, game)) {
 
-        clearDebugInfo(&game);
+        bool repeated;
+        Command command = renderer->pollInput(renderer, game, &repeated);
 
-        addDebugInfoLine(&game, TextFormat("FPS: %d", GetFPS()), WHITE);
+        // auto-explore continues one command per frame until it stops or another command is given
+        if (command == CommandNone && game->autoExplore.active) command = CommandAutoExplore;
 
-        game.deltaTime = GetFrameTime();
-        addDebugInfoLine(&game, TextFormat("Frame time: %f", game.deltaTime), WHITE);
+        updateLevelGeneration(game, false);
+        updateRecording(game);
 
-        if (IsWindowResized()) {
-            game.windowWidth = GetScreenWidth();
-            game.windowHeight = GetScreenHeight();
+        if (command != CommandNone && !game->levelPending) {
+            executeCommand(game, command);
+            recordCommand(game, command);
+            updateActors(game);
+            // held keys move without the step animation
+            if (repeated) game->player.glyph.position = coord2vector(game, game->player.coord);
         }
 
-        // TODO: write custom keys handling and mapping function
+        updateLighting(game);
+        renderer->renderFrame(renderer, game);
+
+    }
+
+}
 
-        if (IsKeyPressed(KEY_R)) generateMap(&game, MAP_WIDTH, MAP_HEIGHT);
-        if (IsKeyPressed(KEY_L)) game.useLOS = !game.useLOS;
-        if (IsKeyPressed(KEY_F1)) game.renderGlyphsCentered = !game.renderGlyphsCentered;
-        if (IsKeyPressed(KEY_F3)) game.ui.debugInfo.visible = !game.ui.debugInfo.visible;
+int main(int argc, char** argv) {
 
-        // up movement
+    const char* recordPath = NULL;
+    bool useTerminal = false;
+    long levelCacheKb = -1;
+
+    MapGenerationBatch batch = {NULL, 1, MAP_GENERATION_BATCH_SEEDS_COUNT, 4, NULL, MAP_WIDTH, MAP_HEIGHT, NULL};
+#ifndef _WIN32
+    batch.threadsCount = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 4;
+#endif
+
+    loadTileDefs(TILE_DEFS_PATH);
+    removeOrphanedLevelSpills();
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench-easing") == 0) {
+            benchmarkEasing();
+            return 0;
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            int loops = i + 2 < argc ? atoi(argv[i + 2]) : 1;
+            return replayRecording(argv[i + 1], loops > 0 ? loops : 1);
+        } else if (strcmp(argv[i], "--test-replay") == 0) {
+            return testReplayLevelChange();
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--terminal") == 0) {
+            useTerminal = true;
+        } else if (strcmp(argv[i], "--level-cache-kb") == 0 && i + 1 < argc) {
+            char* end;
+            levelCacheKb = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || levelCacheKb < 0 || (unsigned long) levelCacheKb > SIZE_MAX / 1024) {
+                printf("ERROR: --level-cache-kb must be a non-negative integer\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--gen-batch") == 0 && i + 1 < argc) {
+            batch.csvPath = argv[++i];
+        } else if (strcmp(argv[i], "--seeds") == 0 && i + 2 < argc) {
+            batch.firstSeed = strtoull(argv[++i], NULL, 10);
+            batch.seedsCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            batch.threadsCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--map-size") == 0 && i + 2 < argc) {
+            batch.width = atoi(argv[++i]);
+            batch.height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--generator") == 0 && i + 1 < argc) {
+            batch.generator = findMapGenerator(argv[++i]);
+            if (batch.generator == NULL) {
+                printf("ERROR: unknown map generator %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--param") == 0 && i + 1 < argc) {
+            if (!setMapGeneratorParam(&mapGeneratorParams, argv[++i])) {
+                printf("ERROR: invalid generator param %s\n", argv[i]);
+                return 1;
+            }
+        }
+    }
 
-        if (IsKeyPressed(KEY_W) || IsKeyPressedRepeat(KEY_W))
-            movePlayer(&game, 0, -1);
-        if (!IsKeyPressed(KEY_W) && IsKeyPressedRepeat(KEY_W))
-            game.player.glyph.position = coord2vector(&game, game.player.coord);
-        if (IsKeyPressed(KEY_W) && IsKeyDown(KEY_LEFT_SHIFT))
-            longMovePlayer(&game, 0, -1);
+    if (batch.csvPath != NULL) {
+        if (batch.seedsCount <= 0 || batch.threadsCount <= 0) {
+            printf("ERROR: invalid batch settings\n");
+            return 1;
+        }
+        if (!validateMapGeneratorParams(&mapGeneratorParams, batch.width, batch.height)) return 1;
+        return runMapGenerationBatch(&batch);
+    }
 
-        // down movement
+    if (!validateMapGeneratorParams(&mapGeneratorParams, MAP_WIDTH, MAP_HEIGHT)) return 1;
 
-        if (IsKeyPressed(KEY_S) || IsKeyPressedRepeat(KEY_S))
-            movePlayer(&game, 0, 1);
-        if (!IsKeyPressed(KEY_S) && IsKeyPressedRepeat(KEY_S))
-            game.player.glyph.position = coord2vector(&game, game.player.coord);
-        if (IsKeyPressed(KEY_S) && IsKeyDown(KEY_LEFT_SHIFT))
-            longMovePlayer(&game, 0, 1);
+    Renderer renderer = useTerminal ? createTerminalRenderer() : createRaylibRenderer();
 
-        // left movement
+    if (renderer.init == NULL) {
+        printf("ERROR: %s renderer is not supported on this platform\n", renderer.name);
+        return 1;
+    }
 
-        if (IsKeyPressed(KEY_A) || IsKeyPressedRepeat(KEY_A))
-            movePlayer(&game, -1, 0);
-        if (!IsKeyPressed(KEY_A) && IsKeyPressedRepeat(KEY_A))
-            game.player.glyph.position = coord2vector(&game, game.player.coord);
-        if (IsKeyPressed(KEY_A) && IsKeyDown(KEY_LEFT_SHIFT))
-            longMovePlayer(&game, -1, 0);
+    Game game = {0};
+    game.windowWidth = WINDOW_WIDTH;
+    game.windowHeight = WINDOW_HEIGHT;
+    game.cellSize = 32;
 
-        // right movement
+    game.useLOS = true;
+    game.lighting.enabled = true;
+    game.renderGlyphsCentered = true;
 
-        if (IsKeyPressed(KEY_D) || IsKeyPressedRepeat(KEY_D))
-            movePlayer(&game, 1, 0);
-        if (!IsKeyPressed(KEY_D) && IsKeyPressedRepeat(KEY_D))
-            game.player.glyph.position = coord2vector(&game, game.player.coord);
-        if (IsKeyPressed(KEY_D) && IsKeyDown(KEY_LEFT_SHIFT))
-            longMovePlayer(&game, 1, 0);
+    game.ui.debugInfo.offset = (Vector2) { 5, 5 };
+    game.ui.debugInfo.bgColor = Fade(BLACK, 0.65f);
 
-        Vector2 mouse = GetMousePosition();
-        game.mouse = mouse;
-        game.mouseCoord = screen2coord(&game, mouse);
+    // without --level-cache-kb initSimulation applies the default budget
+    if (levelCacheKb >= 0) {
+        game.levelCache.memoryBudget = (size_t) levelCacheKb * 1024;
+        game.levelCache.memoryBudgetSet = true;
+    }
 
-        BeginDrawing();
+    if (!renderer.init(&renderer, &game)) return 1;
 
-        ClearBackground(BLACK);
+    if (!useTerminal) printMapGeneratorParams(&mapGeneratorParams, MAP_WIDTH, MAP_HEIGHT);
 
-        renderMap(&game);
-        renderActor(&game, &game.player);
-        renderUI(&game);
+    initSimulation(&game, (uint64_t) time(NULL));
 
-        cameraTarget(&game, game.player.glyph.position);
-        cameraUpdate(&game);
+    if (recordPath != NULL && startRecording(&game, recordPath) && !useTerminal)
+        printf("recording input to %s (seed %llu)\n", recordPath, (unsigned long long) game.seed);
 
-        // DrawFPS(10, 10);
+    runGame(&game, &renderer);
 
-        EndDrawing();
+    stopRecording(&game);
+    shutdownSimulation(&game);
+    renderer.shutdown(&renderer, &game);
 
-    }
-    CloseWindow();
     return 0;
-}
 
+}